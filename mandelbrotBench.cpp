@@ -0,0 +1,279 @@
+#include "mandelbrotEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//MandelBench times the engine on a fixed set of views, for every combination
+//of size, max_iter, kernel and thread count asked for, and writes the results
+//as JSON so they can be compared between builds
+
+//a canonical view. The centers are kept as text so the deep one keeps all of
+//its digits
+struct BenchView {
+    const char *name;
+    const char *center_x;
+    const char *center_y;
+    double zoom;
+    int iterations[2];
+};
+
+static const BenchView views[] = {
+    //the whole set, most pixels escape quickly
+    {"shallow", "-0.5", "0", 1.0, {100, 1000}},
+    //seahorse valley, nearly every pixel is near the boundary
+    {"boundary", "-0.7436", "0.1318", 0.01, {1000, 5000}},
+    //the period 3 bulb, which the cardioid test doesn't catch
+    {"interior", "-0.1225", "0.7449", 0.05, {1000, 10000}},
+    //past the reach of doubles, so it is rendered with perturbation. Below
+    //about 1500 iterations none of it escapes
+    {"deep", "0.013438870532012129028364919004019686867528573314565492885548699",
+             "0.655614218769465062251320027664617466691295975864786403994151735", 1e-18, {2000, 4000}},
+};
+static const int view_count = sizeof(views) / sizeof(views[0]);
+
+//the timings of one combination
+struct BenchResult {
+    std::string view;
+    int size;
+    int iterations;
+    std::string kernel;
+    std::string precision;
+    int threads;
+    std::vector<double> seconds;
+    double median;
+    double p95;
+    long long pixels;
+    long long kernel_iterations;
+    long long skipped;
+};
+
+//prints how to call the program
+void usage(const char *name) {
+    std::cout << "Usage: " << name << " [options]" << std::endl;
+    std::cout << "  --views <list>       views to run, from shallow, boundary, interior and deep" << std::endl;
+    std::cout << "                       (default all of them)" << std::endl;
+    std::cout << "  --sizes <list>       image sizes in pixels, the images are square (default 512,1024)" << std::endl;
+    std::cout << "  --kernels <list>     kernels to time, or all (default the fastest this cpu has)" << std::endl;
+    std::cout << "  --threads <list>     thread counts, 0 is one per hardware thread (default 1,0)" << std::endl;
+    std::cout << "  --runs <n>           timed runs of each combination (default 5)" << std::endl;
+    std::cout << "  --warmup <n>         untimed runs before them (default 1)" << std::endl;
+    std::cout << "  --output <file>      file to write the JSON results to (default bench.json)" << std::endl;
+}
+
+//splits a comma separated list
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+//the median, and the 95th percentile by nearest rank
+void summarize(BenchResult& result) {
+    std::vector<double> sorted = result.seconds;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    result.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    size_t rank = (size_t) std::ceil(0.95 * n);
+    result.p95 = sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results, int runs, int warmup) {
+    char date[32];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    out << "{" << std::endl;
+    out << "  \"date\": \"" << date << "\"," << std::endl;
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << __VERSION__ << "\"," << std::endl;
+#endif
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << "," << std::endl;
+    out << "  \"detected_kernel\": \"" << kernelName(detectKernel()) << "\"," << std::endl;
+    out << "  \"runs\": " << runs << "," << std::endl;
+    out << "  \"warmup\": " << warmup << "," << std::endl;
+    out << "  \"results\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        out << "    {\"view\": \"" << result.view << "\", \"width\": " << result.size
+            << ", \"height\": " << result.size << ", \"max_iter\": " << result.iterations
+            << ", \"kernel\": \"" << result.kernel << "\", \"precision\": \"" << result.precision
+            << "\", \"threads\": " << result.threads << "," << std::endl;
+        out << "     \"seconds\": [";
+        for (size_t j = 0; j < result.seconds.size(); j++) {
+            out << (j > 0 ? ", " : "") << result.seconds[j];
+        }
+        out << "]," << std::endl;
+        out << "     \"median_seconds\": " << result.median << ", \"p95_seconds\": " << result.p95
+            << ", \"pixels\": " << result.pixels << ", \"iterations\": " << result.kernel_iterations
+            << ", \"skipped_iterations\": " << result.skipped << "," << std::endl;
+        out << "     \"mpixels_per_second\": " << result.pixels / result.median / 1e6
+            << ", \"giterations_per_second\": " << result.kernel_iterations / result.median / 1e9
+            << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> view_names;
+    std::vector<int> sizes;
+    std::vector<KernelType> kernels;
+    std::vector<int> thread_counts;
+    int runs = 5;
+    int warmup = 1;
+    std::string output = "bench.json";
+
+    for (int i = 0; i < view_count; i++) view_names.push_back(views[i].name);
+    sizes.push_back(512);
+    sizes.push_back(1024);
+    kernels.push_back(detectKernel());
+    thread_counts.push_back(1);
+    thread_counts.push_back(0);
+
+    //parse the options, each one is followed by one value
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc) {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--views") {
+            view_names = splitList(value);
+        } else if (arg == "--sizes") {
+            sizes.clear();
+            std::vector<std::string> items = splitList(value);
+            for (size_t j = 0; j < items.size(); j++) sizes.push_back(atoi(items[j].c_str()));
+        } else if (arg == "--kernels") {
+            kernels.clear();
+            std::vector<std::string> items = splitList(value);
+            for (size_t j = 0; j < items.size(); j++) {
+                if (items[j] == "all") {
+                    for (int type = 0; type < KERNEL_COUNT; type++) {
+                        if (kernelSupported((KernelType) type)) kernels.push_back((KernelType) type);
+                    }
+                    continue;
+                }
+                KernelType type;
+                if (!parseKernel(items[j], type)) {
+                    std::cerr << "Unknown kernel " << items[j] << std::endl;
+                    return 1;
+                }
+                if (!kernelSupported(type)) {
+                    std::cerr << "This cpu can't run the " << items[j] << " kernel" << std::endl;
+                    return 1;
+                }
+                kernels.push_back(type);
+            }
+        } else if (arg == "--threads") {
+            thread_counts.clear();
+            std::vector<std::string> items = splitList(value);
+            for (size_t j = 0; j < items.size(); j++) thread_counts.push_back(atoi(items[j].c_str()));
+        } else if (arg == "--runs") {
+            runs = atoi(value.c_str());
+        } else if (arg == "--warmup") {
+            warmup = atoi(value.c_str());
+        } else if (arg == "--output") {
+            output = value;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (runs <= 0 || warmup < 0 || sizes.empty() || kernels.empty() || thread_counts.empty()) {
+        std::cerr << "Needs at least one run, size, kernel and thread count" << std::endl;
+        return 1;
+    }
+    std::vector<const BenchView *> chosen;
+    for (size_t i = 0; i < view_names.size(); i++) {
+        const BenchView *view = NULL;
+        for (int j = 0; j < view_count; j++) {
+            if (view_names[i] == views[j].name) view = &views[j];
+        }
+        if (view == NULL) {
+            std::cerr << "Unknown view " << view_names[i] << std::endl;
+            return 1;
+        }
+        chosen.push_back(view);
+    }
+
+    //0 threads means the hardware threads, which may be the same as another count
+    int hardware = (int) std::thread::hardware_concurrency();
+    for (size_t i = 0; i < thread_counts.size(); i++) {
+        if (thread_counts[i] <= 0) thread_counts[i] = hardware > 0 ? hardware : 1;
+    }
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::vector<BenchResult> results;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        if (sizes[s] <= 0) continue;
+        MandelbrotEngine brot(sizes[s], sizes[s], thread_counts[0]);
+        for (size_t t = 0; t < thread_counts.size(); t++) {
+            if (t > 0) brot.setThreads(thread_counts[t]);
+            for (size_t k = 0; k < kernels.size(); k++) {
+                brot.setKernel(kernels[k]);
+                for (size_t v = 0; v < chosen.size(); v++) {
+                    for (int it = 0; it < 2; it++) {
+                        const BenchView& view = *chosen[v];
+                        BenchResult result;
+                        result.view = view.name;
+                        result.size = sizes[s];
+                        result.iterations = view.iterations[it];
+                        result.kernel = kernelName(kernels[k]);
+                        result.threads = brot.getThreads();
+
+                        //every run renders the view from scratch, since nothing
+                        //is cached and max_iter doesn't change between them
+                        brot.resetMandelbrot();
+                        brot.setIterations(view.iterations[it]);
+                        brot.changePos(brot.getMandelbrotCenter(), view.zoom);
+                        brot.setCenter(view.center_x, view.center_y);
+                        result.precision = precisionName(brot.getPrecision());
+                        for (int run = 0; run < warmup + runs; run++) {
+                            brot.generate();
+                            if (run < warmup) continue;
+                            result.seconds.push_back(brot.getStats().seconds);
+                        }
+                        result.pixels = brot.getStats().pixels;
+                        result.kernel_iterations = brot.getStats().kernel.iterations;
+                        result.skipped = brot.getStats().kernel.skipped;
+                        summarize(result);
+
+                        std::cout << result.view << " " << result.size << "x" << result.size
+                                  << " max_iter " << result.iterations << ", " << result.kernel
+                                  << " " << result.precision << ", " << result.threads << " threads: median "
+                                  << result.median << "s, p95 " << result.p95 << "s, "
+                                  << result.pixels / result.median / 1e6 << " Mpixels/s, "
+                                  << result.kernel_iterations / result.median / 1e9 << " Giterations/s"
+                                  << std::endl;
+                        results.push_back(result);
+                    }
+                }
+            }
+        }
+    }
+
+    std::ofstream file(output.c_str());
+    if (!file) {
+        std::cerr << "Could not write the results to " << output << std::endl;
+        return 1;
+    }
+    writeJson(file, results, runs, warmup);
+    std::cout << "Wrote the results to " << output << std::endl;
+    return 0;
+}
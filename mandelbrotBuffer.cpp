@@ -0,0 +1,139 @@
+#include "mandelbrotBuffer.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+IterationBuffer::IterationBuffer() {
+    width = 0;
+    height = 0;
+    stride = 0;
+    bytes = 0;
+    compact = true;
+    data = NULL;
+}
+
+IterationBuffer::~IterationBuffer() {
+    free(data);
+}
+
+//allocates a cleared buffer with the narrowest elements that fit max_iter
+void IterationBuffer::create(int w, int h, int max_iter) {
+    allocate(w, h, max_iter <= compact_limit);
+}
+
+//widens the buffer if max_iter doesn't fit anymore. It never narrows, because
+//the values already in it might not fit
+void IterationBuffer::reserve(int max_iter) {
+    if (!compact || max_iter <= compact_limit) return;
+
+    //copy the values out row by row, then put them back in the wide buffer
+    int *old = new int[(size_t) width * height];
+    for (int y = 0; y < height; y++) {
+        getRow(0, y, width, old + (size_t) y * width);
+    }
+    allocate(width, height, false);
+    for (int y = 0; y < height; y++) {
+        setRow(0, y, width, old + (size_t) y * width);
+    }
+    delete[] old;
+}
+
+//copies part of a row out of the buffer
+void IterationBuffer::getRow(int x, int y, int count, int *iters) const {
+    size_t start = (size_t) y * stride + x;
+    if (compact) {
+        const uint16_t *row = (const uint16_t *) data + start;
+        for (int i = 0; i < count; i++) iters[i] = row[i];
+    } else {
+        const uint32_t *row = (const uint32_t *) data + start;
+        for (int i = 0; i < count; i++) iters[i] = (int) row[i];
+    }
+}
+
+//copies part of a row into the buffer
+void IterationBuffer::setRow(int x, int y, int count, const int *iters) {
+    size_t start = (size_t) y * stride + x;
+    if (compact) {
+        uint16_t *row = (uint16_t *) data + start;
+        for (int i = 0; i < count; i++) row[i] = (uint16_t) iters[i];
+    } else {
+        uint32_t *row = (uint32_t *) data + start;
+        for (int i = 0; i < count; i++) row[i] = (uint32_t) iters[i];
+    }
+}
+
+void IterationBuffer::shift(int dx, int dy) {
+    size_t element = compact ? sizeof(uint16_t) : sizeof(uint32_t);
+    shiftPixels(data, stride * element, element, width, height, dx, dy);
+}
+
+//the rows are moved one at a time, in the order that doesn't overwrite rows
+//that haven't been moved yet
+void shiftPixels(void *data, size_t stride, size_t element, int width, int height, int dx, int dy) {
+    if (dx <= -width || dx >= width || dy <= -height || dy >= height) return;
+    int count = width - abs(dx);
+    int from_x = dx < 0 ? -dx : 0;
+    int to_x = dx > 0 ? dx : 0;
+    for (int i = 0; i < height - abs(dy); i++) {
+        int y = dy > 0 ? height - 1 - i : i;
+        char *to = (char *) data + y * stride + to_x * element;
+        const char *from = (const char *) data + (y - dy) * stride + from_x * element;
+        memmove(to, from, count * element);
+    }
+}
+
+PixelBuffer::PixelBuffer() {
+    width = 0;
+    height = 0;
+    data = NULL;
+}
+
+PixelBuffer::~PixelBuffer() {
+    free(data);
+}
+
+void PixelBuffer::create(int w, int h) {
+    free(data);
+    data = NULL;
+    width = w;
+    height = h;
+    size_t bytes = (size_t) width * height * sizeof(uint32_t);
+    if (bytes == 0) return;
+
+    void *memory;
+    if (posix_memalign(&memory, alignment, bytes) != 0) throw std::bad_alloc();
+    data = (uint32_t *) memory;
+    uint32_t black;
+    const uint8_t opaque_black[4] = {0, 0, 0, 255};
+    memcpy(&black, opaque_black, sizeof(black));
+    for (size_t i = 0; i < (size_t) width * height; i++) data[i] = black;
+}
+
+void PixelBuffer::copyRect(int x, int y, int w, int h, uint8_t *out) const {
+    for (int row = 0; row < h; row++) {
+        memcpy(out + (size_t) row * w * 4, &data[(size_t) (y + row) * width + x], (size_t) w * 4);
+    }
+}
+
+void PixelBuffer::shift(int dx, int dy) {
+    shiftPixels(data, (size_t) width * sizeof(uint32_t), sizeof(uint32_t), width, height, dx, dy);
+}
+
+//replaces the memory with a cleared, aligned allocation. Rows are padded out to a
+//whole number of cache lines
+void IterationBuffer::allocate(int w, int h, bool narrow) {
+    free(data);
+    data = NULL;
+
+    width = w;
+    height = h;
+    compact = narrow;
+    size_t element = compact ? sizeof(uint16_t) : sizeof(uint32_t);
+    size_t per_line = alignment / element;
+    stride = ((size_t) width + per_line - 1) / per_line * per_line;
+    bytes = stride * height * element;
+    if (bytes == 0) return;
+
+    if (posix_memalign(&data, alignment, bytes) != 0) throw std::bad_alloc();
+    memset(data, 0, bytes);
+}
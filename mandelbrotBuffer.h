@@ -0,0 +1,127 @@
+#ifndef MANDELBROTBUFFER_H
+#define MANDELBROTBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+//IterationBuffer stores the escape time of every pixel in one contiguous, aligned
+//allocation. Every row starts on a cache line, so tiles never share a line with
+//their neighbours' rows. When max_iter fits in 16 bits the values are stored as
+//uint16_t, which halves the memory used by big renders; otherwise they are
+//uint32_t.
+class IterationBuffer {
+    public:
+        IterationBuffer();
+        ~IterationBuffer();
+
+        //the buffer owns its memory, so it can't be copied
+        IterationBuffer(const IterationBuffer&) = delete;
+        IterationBuffer& operator=(const IterationBuffer&) = delete;
+
+        //allocates a buffer for width x height pixels that can hold escape times
+        //up to max_iter. The values are cleared to 0
+        void create(int width, int height, int max_iter);
+
+        //makes sure the buffer can hold escape times up to max_iter, widening the
+        //elements (and keeping the values) if it has to
+        void reserve(int max_iter);
+
+        //Accessor functions:
+        int getWidth() const {return width;}
+        int getHeight() const {return height;}
+        bool isCompact() const {return compact;}
+        size_t getBytes() const {return bytes;}
+
+        //the escape time of one pixel
+        int get(int x, int y) const {
+            size_t i = (size_t) y * stride + x;
+            return compact ? ((const uint16_t *) data)[i] : (int) ((const uint32_t *) data)[i];
+        }
+        void set(int x, int y, int iter) {
+            size_t i = (size_t) y * stride + x;
+            if (compact) ((uint16_t *) data)[i] = (uint16_t) iter;
+            else ((uint32_t *) data)[i] = (uint32_t) iter;
+        }
+
+        //copies count escape times of row y, starting at column x, out of or into
+        //the buffer
+        void getRow(int x, int y, int count, int *iters) const;
+        void setRow(int x, int y, int count, const int *iters);
+
+        //moves every value dx columns right and dy rows down (see shiftPixels)
+        void shift(int dx, int dy);
+
+    private:
+        int width;
+        int height;
+
+        //the number of elements from the start of one row to the start of the next
+        size_t stride;
+        size_t bytes;
+        bool compact;
+        void *data;
+
+        //the largest value a compact buffer can hold
+        static const int compact_limit = 65535;
+
+        //the size of a cache line, which the rows are aligned to
+        static const int alignment = 64;
+
+        void allocate(int width, int height, bool compact);
+};
+
+//PixelBuffer is the colored image, as RGBA bytes in one aligned allocation. The
+//worker threads write their tiles straight into it without any locks, since
+//the tiles don't overlap. Unlike the IterationBuffer the rows aren't padded,
+//so the whole buffer, or any run of whole rows, can be uploaded to a texture
+//as it is
+class PixelBuffer {
+    public:
+        PixelBuffer();
+        ~PixelBuffer();
+
+        //the buffer owns its memory, so it can't be copied
+        PixelBuffer(const PixelBuffer&) = delete;
+        PixelBuffer& operator=(const PixelBuffer&) = delete;
+
+        //allocates a buffer for width x height pixels, all opaque black
+        void create(int width, int height);
+
+        //Accessor functions:
+        int getWidth() const {return width;}
+        int getHeight() const {return height;}
+        const uint8_t *getPixels() const {return (const uint8_t *) data;}
+        uint32_t *getRow(int y) {return &data[(size_t) y * width];}
+
+        //one pixel as its four bytes, in the order they are in memory
+        uint32_t get(int x, int y) const {return data[(size_t) y * width + x];}
+        void set(int x, int y, uint32_t rgba) {data[(size_t) y * width + x] = rgba;}
+        void set(int x, int y, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+            uint8_t *pixel = (uint8_t *) &data[(size_t) y * width + x];
+            pixel[0] = r;
+            pixel[1] = g;
+            pixel[2] = b;
+            pixel[3] = a;
+        }
+
+        //copies a rectangle of the image out, packed into w * h * 4 bytes
+        void copyRect(int x, int y, int w, int h, uint8_t *out) const;
+
+        //moves every pixel dx columns right and dy rows down (see shiftPixels)
+        void shift(int dx, int dy);
+
+    private:
+        int width;
+        int height;
+        uint32_t *data;
+
+        //the size of a cache line, which the buffer is aligned to
+        static const int alignment = 64;
+};
+
+//moves a width x height array, with elements of the given size and rows stride
+//bytes apart, dx columns right and dy rows down. What moves off the edge is
+//lost, and what it uncovers is left as it was
+void shiftPixels(void *data, size_t stride, size_t element, int width, int height, int dx, int dy);
+
+#endif
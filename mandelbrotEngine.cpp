@@ -0,0 +1,1336 @@
+#include "mandelbrotEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+//Constructor
+MandelbrotEngine::MandelbrotEngine(int w, int h, int threads) {
+    width = w;
+    height = h;
+
+    //start the worker threads
+    scheduler = NULL;
+    tile_size = 64;
+    subdivision = false;
+    progressive = false;
+    supersample_grid = 1;
+    supersample_jitter = 0.0;
+    supersample_threshold = 0;
+    pass_step = pass_first = 1;
+    profiling = false;
+    copy_seconds = 0.0;
+    farm = NULL;
+    cancelled = false;
+    setThreads(threads);
+
+    //the precision tiers, chosen for each view unless one is forced
+    tiers[PRECISION_FLOAT] = &float_kernel;
+    tiers[PRECISION_DOUBLE] = &double_kernel;
+    tiers[PRECISION_DOUBLE_DOUBLE] = &double_double_kernel;
+    tiers[PRECISION_QUAD] = &quad_kernel;
+    tiers[PRECISION_PERTURBATION] = &perturbation_kernel;
+    perturbation_kernel.setCancel(&cancelled);
+    precision = PRECISION_AUTO;
+    tier = PRECISION_DOUBLE;
+
+    //initialize the mandelbrot parameters
+    resetMandelbrot();
+
+    //initialize the image
+    framebuffer.create(width, height);
+    dirty = sf::Rect<int>(0, 0, width, height);
+    scheme = 1;
+    initPalette();
+
+    iterations.create(width, height, max_iter);
+
+    //pick the fastest kernel, unless MANDELBROT_KERNEL asks for a specific one
+    lane_refill = true;
+    setKernel(detectKernel());
+    const char *forced = getenv("MANDELBROT_KERNEL");
+    if (forced != NULL) {
+        KernelType type;
+        if (!parseKernel(forced, type) || !setKernel(type)) {
+            std::cerr << "Can't use kernel " << forced << ", using "
+                      << kernelName(kernel_type) << std::endl;
+        }
+    }
+}
+
+MandelbrotEngine::~MandelbrotEngine() {
+    delete scheduler;
+}
+
+//replaces the worker pool
+void MandelbrotEngine::setThreads(int threads) {
+    delete scheduler;
+    scheduler = new TileScheduler(threads);
+    scheduler->setTiming(profiling);
+    scratch.resize(scheduler->getThreads());
+}
+
+//return the center of the area of the complex plane
+sf::Vector2<double> MandelbrotEngine::getMandelbrotCenter() {
+    sf::Vector2<double> center;
+    center.x = area.left + area.width/2.0;
+    center.y = area.top + area.height/2.0;
+    return center;
+}
+
+//the tier depends on how far apart the pixels are compared to the size of
+//the coordinates. A forced float tier falls back to doubles past the highest
+//max_iter its kernels can count to
+PrecisionTier MandelbrotEngine::getPrecision() {
+    if (precision == PRECISION_FLOAT && max_iter > float_max_iter) return PRECISION_DOUBLE;
+    if (precision != PRECISION_AUTO) return precision;
+    double spacing = interpolate(area.width, width);
+    double scale = std::max(1.0, std::max(std::fabs(area.left), std::fabs(area.top)));
+    return choosePrecision(spacing, scale, max_iter);
+}
+
+bool MandelbrotEngine::setPrecision(PrecisionTier tier) {
+    if (!precisionSupported(tier)) return false;
+    precision = tier;
+    return true;
+}
+
+//forces a specific escape kernel, for both the float and double tiers
+bool MandelbrotEngine::setKernel(KernelType type) {
+    if (!kernelSupported(type)) return false;
+    kernel_type = type;
+    double_kernel.setKernel(::getKernel(type, lane_refill));
+    float_kernel.setKernel(getFloatKernel(type));
+    color_kernel = getColorKernel(type);
+    double_double_kernel.setKernel(type);
+    return true;
+}
+
+//Functions to change parameters of mandelbrot
+
+//regenerates the image with the new color multiplier, without regenerating
+//the mandelbrot
+void MandelbrotEngine::changeColor() {
+    //only generate() can be cancelled, a cancel() that came too late for the
+    //last one doesn't apply to this
+    cancelled = false;
+    updateColors();
+    scheduler->run(makeTiles(width, height, tile_size), [this] (const Tile& tile, int worker) {
+        recolorTile(tile, worker);
+    });
+    if (rendered) supersample();
+    markDirty(sf::Rect<int>(0, 0, width, height));
+}
+
+//changes the parameters of the mandelbrot: sets new center and zooms accordingly
+//does not regenerate the image
+void MandelbrotEngine::changePos(sf::Vector2<double> new_center, double zoom_factor) {
+    area.width = area.width * zoom_factor;
+    area.height = area.height * zoom_factor;
+    setCenter(HighPrecision(new_center.x, HighPrecision::max_limbs),
+              HighPrecision(new_center.y, HighPrecision::max_limbs));
+    //NOTE: this is a relative zoom
+}
+
+//moves the high precision center by the pixel offset, which is small enough to
+//add as a double
+void MandelbrotEngine::changePosPixel(sf::Vector2<double> new_center, double zoom_factor) {
+    center_x += (new_center.x - width / 2.0) * interpolate(area.width, width);
+    center_y += (new_center.y - height / 2.0) * interpolate(area.height, height);
+    area.width = area.width * zoom_factor;
+    area.height = area.height * zoom_factor;
+    setCenter(center_x, center_y);
+}
+
+//sets a new center, which invalidates everything generated for the old one
+void MandelbrotEngine::setCenter(const HighPrecision& x, const HighPrecision& y) {
+    center_x = x;
+    center_y = y;
+    updateArea();
+    resume_valid = false;
+    rendered = false;
+    kept = sf::Rect<int>();
+    kept_step = 1;
+}
+
+bool MandelbrotEngine::setCenter(const std::string& x, const std::string& y) {
+    HighPrecision new_x, new_y;
+    if (!HighPrecision::parse(x, HighPrecision::max_limbs, new_x)) return false;
+    if (!HighPrecision::parse(y, HighPrecision::max_limbs, new_y)) return false;
+    setCenter(new_x, new_y);
+    return true;
+}
+
+//the area is centered on the high precision center
+void MandelbrotEngine::updateArea() {
+    origin_x = center_x;
+    origin_y = center_y;
+    shift_x = shift_y = 0;
+    origin_column = width / 2.0;
+    origin_row = height / 2.0;
+
+    //the grid's hash for the cache and store, which is the same in every run
+    uint64_t h = 14695981039346656037ULL;
+    uint64_t parts[6] = {center_x.hash(), center_y.hash(), 0, 0, (uint64_t) width, (uint64_t) height};
+    memcpy(&parts[2], &area.width, sizeof(double));
+    memcpy(&parts[3], &area.height, sizeof(double));
+    for (int i = 0; i < 6; i++) {
+        h ^= parts[i];
+        h *= 1099511628211ULL;
+    }
+    grid_hash = h;
+    grid_level = 0;
+    grid_left = area.left = center_x.toDouble() - area.width / 2.0;
+    grid_top = area.top = center_y.toDouble() - area.height / 2.0;
+}
+
+//puts the center and area where the window is on the grid
+void MandelbrotEngine::moveCenter() {
+    double x_inc = interpolate(area.width, width);
+    double y_inc = interpolate(area.height, height);
+    center_x = origin_x;
+    center_x += (width / 2.0 + shift_x - origin_column) * x_inc;
+    center_y = origin_y;
+    center_y += (height / 2.0 + shift_y - origin_row) * y_inc;
+    area.left = grid_left + shift_x * x_inc;
+    area.top = grid_top + shift_y * y_inc;
+}
+
+//moves the window over the grid instead of moving the grid, and moves the
+//image and the escape times with it. The part of the last render that is still
+//in view is kept for the next generate()
+void MandelbrotEngine::panPixels(int dx, int dy) {
+    if (dx == 0 && dy == 0) return;
+    shift_x += dx;
+    shift_y += dy;
+    moveCenter();
+
+    //a complete render is all kept, a moved one that wasn't generated yet
+    //only keeps what was left of it. A corner that gets cut off has to move
+    //on to the next kept pixel
+    if (rendered) {
+        kept = sf::Rect<int>(0, 0, width, height);
+        kept_step = 1;
+    }
+    if (kept.width > 0 && kept.height > 0) {
+        int left = kept.left - dx;
+        int top = kept.top - dy;
+        int right = std::min(left + kept.width, width);
+        int bottom = std::min(top + kept.height, height);
+        if (left < 0) left += (-left + kept_step - 1) / kept_step * kept_step;
+        if (top < 0) top += (-top + kept_step - 1) / kept_step * kept_step;
+        kept = sf::Rect<int>(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+        if (kept.width == 0 || kept.height == 0) kept = sf::Rect<int>();
+    }
+    rendered = false;
+    resume_valid = false;
+
+    sf::Clock copy_clock;
+    iterations.shift(-dx, -dy);
+    framebuffer.shift(-dx, -dy);
+    copy_seconds += copy_clock.getElapsedTime().asSeconds();
+    markDirty(sf::Rect<int>(0, 0, width, height));
+}
+
+//zooms around the middle pixel, so that it stays on the grid. Zooming in,
+//every other pixel of the new view is one of the old ones, zooming out the old
+//pixels on even columns and rows fill the middle quarter
+void MandelbrotEngine::zoomStep(bool zoom_in) {
+    int middle_x = width / 2;
+    int middle_y = height / 2;
+    int old_shift_x = shift_x;
+    int old_shift_y = shift_y;
+    long long new_shift_x = zoom_in ? 2LL * (middle_x + shift_x) - middle_x :
+                                      (long long) std::floor((middle_x + shift_x) / 2.0) - middle_x;
+    long long new_shift_y = zoom_in ? 2LL * (middle_y + shift_y) - middle_y :
+                                      (long long) std::floor((middle_y + shift_y) / 2.0) - middle_y;
+
+    //the grid only stays exact while the window is near its corner, past
+    //that it starts over at the middle pixel and nothing is kept
+    if (std::llabs(new_shift_x) > max_shift || std::llabs(new_shift_y) > max_shift) {
+        changePosPixel(sf::Vector2<double>(middle_x, middle_y), zoom_in ? 0.5 : 2.0);
+        return;
+    }
+
+    double scale = zoom_in ? 0.5 : 2.0;
+    area.width = area.width * scale;
+    area.height = area.height * scale;
+    origin_column /= scale;
+    origin_row /= scale;
+    grid_level += zoom_in ? 1 : -1;
+    shift_x = (int) new_shift_x;
+    shift_y = (int) new_shift_y;
+    moveCenter();
+    resume_valid = false;
+
+    //only a complete render can be moved onto the new grid
+    kept = sf::Rect<int>();
+    kept_step = 1;
+    if (!rendered) return;
+    rendered = false;
+
+    //find the old pixel each new one comes from. Zooming in, the ones in
+    //between get the color of their neighbour until they are generated
+    std::vector<int> columns(width), rows(height);
+    for (int x = 0; x < width; x++) {
+        int column = zoom_in ? (x + middle_x) / 2 : 2 * (x + shift_x) - old_shift_x;
+        columns[x] = column >= 0 && column < width ? column : -1;
+    }
+    for (int y = 0; y < height; y++) {
+        int row = zoom_in ? (y + middle_y) / 2 : 2 * (y + shift_y) - old_shift_y;
+        rows[y] = row >= 0 && row < height ? row : -1;
+    }
+    if (zoom_in) {
+        kept = sf::Rect<int>(middle_x % 2, middle_y % 2, width - middle_x % 2, height - middle_y % 2);
+        kept_step = 2;
+    } else {
+        int left = std::find_if(columns.begin(), columns.end(), [] (int c) {return c >= 0;}) - columns.begin();
+        int top = std::find_if(rows.begin(), rows.end(), [] (int r) {return r >= 0;}) - rows.begin();
+        int right = std::find_if(columns.begin() + left, columns.end(), [] (int c) {return c < 0;}) - columns.begin();
+        int bottom = std::find_if(rows.begin() + top, rows.end(), [] (int r) {return r < 0;}) - rows.begin();
+        if (right > left && bottom > top) kept = sf::Rect<int>(left, top, right - left, bottom - top);
+    }
+
+    sf::Clock copy_clock;
+    std::vector<int> old_iters((size_t) width * height);
+    for (int y = 0; y < height; y++) {
+        iterations.getRow(0, y, width, &old_iters[(size_t) y * width]);
+    }
+    std::vector<uint32_t> old_pixels((size_t) width * height);
+    framebuffer.copyRect(0, 0, width, height, (uint8_t *) &old_pixels[0]);
+    std::vector<int> row_iters(width);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            row_iters[x] = 0;
+            if (rows[y] < 0 || columns[x] < 0) {
+                setPixel(x, y, sf::Color::Black);
+                continue;
+            }
+            size_t from = (size_t) rows[y] * width + columns[x];
+            row_iters[x] = old_iters[from];
+            framebuffer.set(x, y, old_pixels[from]);
+        }
+        iterations.setRow(0, y, width, &row_iters[0]);
+    }
+    copy_seconds += copy_clock.getElapsedTime().asSeconds();
+    markDirty(sf::Rect<int>(0, 0, width, height));
+}
+
+//generate the mandelbrot. Every worker function checks for cancel() before
+//it starts a tile, and the kernels check while they iterate, so a cancelled
+//render only leaves the tiles it finished
+bool MandelbrotEngine::generate() {
+    sf::Clock clock;
+    cancelled = false;
+    for (size_t i = 0; i < scratch.size(); i++) {
+        scratch[i].pixels = 0;
+        scratch[i].filled = 0;
+        scratch[i].cached = 0;
+        scratch[i].loaded = 0;
+        scratch[i].color_seconds = 0.0;
+        scratch[i].stats = KernelStats();
+    }
+    if (profiling) scheduler->resetWorkerStats();
+
+    //get the tier for this view ready. Only the float and double tiers can
+    //be resumed, and only by the same tier
+    PrecisionTier last_tier = tier;
+    tier = getPrecision();
+    tiers[tier]->prepare(origin_x, origin_y, interpolate(area.width, width), max_iter);
+    if (tier != last_tier || !tiers[tier]->canResume()) resume_valid = false;
+
+    //after a pan or zoom step only the pixels that weren't kept are missing,
+    //as long as the kept ones were generated the same way
+    bool reusing = kept.width > 0 && kept.height > 0 && tier == last_tier && max_iter == last_max_iter;
+    if (!reusing) kept = sf::Rect<int>();
+
+    //make sure the iteration buffer can hold the new max_iter, and the
+    //color table goes up to it
+    iterations.reserve(max_iter);
+    updateColors();
+
+    //split the image into tiles lined up with the grid and let the workers
+    //generate them. If only max_iter changed, the pixels that already escaped
+    //don't need to be generated again
+    tile_offset_x = (shift_x % tile_size + tile_size) % tile_size;
+    tile_offset_y = (shift_y % tile_size + tile_size) % tile_size;
+    std::vector<Tile> tiles = makeTiles(width, height, tile_size, tile_offset_x, tile_offset_y);
+    bool resuming = resume_valid && max_iter != last_max_iter;
+    if (profiling) {
+        profile.tiles = tiles;
+        profile.tile_seconds.assign(tiles.size(), 0.0);
+        profile.tile_iterations.assign(tiles.size(), 0);
+    }
+
+    //otherwise the tiles that are in the cache don't need to be generated,
+    //and neither do the ones that were all kept
+    bool caching = cache.getBudget() > 0 || (store.isOpen() && store.getTileSize() == tile_size);
+    cache_hits.assign(tiles.size(), 0);
+    std::vector<Tile> missing;
+    if (!resuming) {
+        std::vector<Tile> lookup;
+        for (size_t i = 0; i < tiles.size(); i++) {
+            if (!reusing || !isKept(tiles[i])) lookup.push_back(tiles[i]);
+        }
+        if (caching) {
+            scheduler->run(lookup, [this] (const Tile& tile, int worker) {
+                if (cancelled) return;
+                TileTimer timer;
+                startTile(timer, worker);
+                findTile(tile, worker);
+                finishTile(tile, worker, timer);
+            });
+        }
+        for (size_t i = 0; i < lookup.size(); i++) {
+            if (!cache_hits[tileIndex(lookup[i])]) missing.push_back(lookup[i]);
+            else markDirty(lookup[i]);
+        }
+    }
+
+    double first_pass = -1.0;
+    long long remote = 0;
+    if (reusing) {
+        //the new pixels are few enough that they don't need to be shown in
+        //passes. The farm generates whole tiles, which gives the kept pixels
+        //of the ones at the edge of what was kept again
+        resume.clear();
+        resume.resize(tiles.size());
+        remote = farmTiles(missing, caching);
+        scheduler->run(missing, [this, caching] (const Tile& tile, int worker) {
+            if (cancelled) return;
+            TileTimer timer;
+            startTile(timer, worker);
+            genTile(tile, worker);
+            if (caching && !cancelled) storeTile(tile, worker);
+            finishTile(tile, worker, timer);
+            markDirty(tile);
+        });
+        resume_valid = false;
+    } else if (resume_valid && max_iter > last_max_iter) {
+        scheduler->run(tiles, [this, caching] (const Tile& tile, int worker) {
+            if (cancelled) return;
+            TileTimer timer;
+            startTile(timer, worker);
+            resumeTile(tile, worker);
+            if (caching && !cancelled) storeTile(tile, worker);
+            finishTile(tile, worker, timer);
+            markDirty(tile);
+        });
+    } else if (resume_valid && max_iter < last_max_iter) {
+        //the pixels that get clamped to the lower max_iter weren't saved, so
+        //the next increase has to start over
+        scheduler->run(tiles, [this, caching] (const Tile& tile, int worker) {
+            if (cancelled) return;
+            TileTimer timer;
+            startTile(timer, worker);
+            clampTile(tile);
+            if (caching) storeTile(tile, worker);
+            finishTile(tile, worker, timer);
+            markDirty(tile);
+        });
+        resume_valid = false;
+    } else {
+        //a progressive render goes over the tiles once for each pass, halving
+        //the spacing of the pixels every time
+        bool complete = missing.size() == tiles.size();
+        resume.clear();
+        resume.resize(tiles.size());
+        if (!progressive) remote = farmTiles(missing, caching);
+        pass_first = progressive ? 8 : 1;
+        for (pass_step = pass_first; pass_step >= 1 && !cancelled; pass_step /= 2) {
+            scheduler->run(missing, [this, caching] (const Tile& tile, int worker) {
+                if (cancelled) return;
+                TileTimer timer;
+                startTile(timer, worker);
+                genTile(tile, worker);
+                if (caching && pass_step == 1 && !cancelled) storeTile(tile, worker);
+                finishTile(tile, worker, timer);
+                markDirty(tile);
+            });
+            if (pass_step == pass_first) first_pass = clock.getElapsedTime().asSeconds();
+            if (progressive && pass_function && !cancelled) pass_function(pass_step);
+        }
+        pass_step = pass_first = 1;
+        resume_valid = complete && remote == 0 && tiers[tier]->canResume();
+    }
+    if (!cancelled) supersample();
+
+    //add up what all the workers did
+    stats.seconds = clock.getElapsedTime().asSeconds();
+    stats.first_pass = first_pass < 0.0 ? stats.seconds : first_pass;
+    stats.pixels = 0;
+    stats.filled = 0;
+    stats.cached = 0;
+    stats.loaded = 0;
+    stats.remote = remote;
+    stats.reused = 0;
+    if (reusing) {
+        stats.reused = (long long) ((kept.width + kept_step - 1) / kept_step) *
+                       ((kept.height + kept_step - 1) / kept_step);
+    }
+    stats.kernel = KernelStats();
+    for (size_t i = 0; i < scratch.size(); i++) {
+        stats.pixels += scratch[i].pixels;
+        stats.filled += scratch[i].filled;
+        stats.cached += scratch[i].cached;
+        stats.loaded += scratch[i].loaded;
+        stats.kernel.iterations += scratch[i].stats.iterations;
+        stats.kernel.lane_slots += scratch[i].stats.lane_slots;
+        stats.kernel.interior += scratch[i].stats.interior;
+        stats.kernel.periodic += scratch[i].stats.periodic;
+        stats.kernel.rebases += scratch[i].stats.rebases;
+        stats.kernel.skipped += scratch[i].stats.skipped;
+    }
+    stats.series_saved = 0.0;
+    if (stats.kernel.iterations > 0) {
+        stats.series_saved = stats.seconds * stats.kernel.skipped / stats.kernel.iterations;
+    }
+    if (profiling) {
+        profile.workers = scheduler->getWorkerStats();
+        profile.color_seconds = 0.0;
+        for (size_t i = 0; i < scratch.size(); i++) profile.color_seconds += scratch[i].color_seconds;
+        profile.copy_seconds = copy_seconds;
+    }
+    copy_seconds = 0.0;
+    last_max_iter = max_iter;
+
+    //a cancelled render can't be resumed or moved, but what was kept for it
+    //is still there for the next one
+    if (cancelled) {
+        resume_valid = false;
+        rendered = false;
+        return false;
+    }
+    kept = sf::Rect<int>();
+    rendered = true;
+    return true;
+}
+
+//adds the time and iterations a tile took to the profile. Each tile is only
+//done by one worker at a time, so they can be added without a lock
+void MandelbrotEngine::finishTile(const Tile& tile, int worker, const TileTimer& timer) {
+    if (!profiling) return;
+    int index = tileIndex(tile);
+    profile.tile_seconds[index] += timer.clock.getElapsedTime().asSeconds();
+    profile.tile_iterations[index] += scratch[worker].stats.iterations - timer.iterations;
+}
+
+void MandelbrotEngine::setProfiling(bool enable) {
+    profiling = enable;
+    scheduler->setTiming(enable);
+    profile = RenderProfile();
+}
+
+//this is a private worker thread function. It generates all the pixels of a tile
+//in the current pass as a single batch for the kernel, so the refilling kernels
+//can keep their lanes busy across rows. The tiles don't overlap, so the results
+//can be written without any locks
+void MandelbrotEngine::genTile(const Tile& tile, int worker) {
+    WorkerScratch& work = scratch[worker];
+    double x_inc = interpolate(area.width, width);
+    double y_inc = interpolate(area.height, height);
+    reserveScratch(work, tile.width * tile.height);
+
+    //calculate the coordinates of every pixel of the pass in the complex plane,
+    //each one starts at z = c. The deep tiers take the offsets from the grid's
+    //origin instead. A progressive pass, or a tile that was partly kept after a
+    //pan, only has some of the pixels, so it keeps their index in the tile in
+    //pending
+    const PrecisionKernel *kernel = tiers[tier];
+    bool offsets = kernel->usesOffsets();
+    bool whole = pass_first == 1 && kept.width == 0;
+    work.pending.clear();
+    int i = 0;
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        double y = offsets ? (row + shift_y - origin_row) * y_inc : grid_top + (row + shift_y) * y_inc;
+        for (int column = tile.x; column < tile.x + tile.width; column++) {
+            if (!whole && !needsPixel(column, row)) continue;
+            work.cx[i] = work.zx[i] = offsets ? (column + shift_x - origin_column) * x_inc :
+                                                grid_left + (column + shift_x) * x_inc;
+            work.cy[i] = work.zy[i] = y;
+            work.iters[i] = 0;
+            if (!whole) work.pending.push_back((row - tile.y) * tile.width + column - tile.x);
+            i++;
+        }
+    }
+    int count = i;
+    if (count == 0) return;
+
+    //now generate all the pixels in the tile
+    bool subdivided = subdivision && whole;
+    if (subdivided) {
+        subdivideTile(tile, work);
+    } else {
+        EscapeBatch batch = {&work.cx[0], &work.cy[0], &work.zx[0], &work.zy[0], &work.iters[0], count,
+                             &cancelled};
+        kernel->escape(batch, max_iter, work.stats);
+        work.pixels += count;
+    }
+    if (cancelled) return;
+
+    sf::Clock color_clock;
+    if (whole) {
+        i = 0;
+        for (int row = tile.y; row < tile.y + tile.height; row++) {
+            iterations.setRow(tile.x, row, tile.width, &work.iters[i]);
+            colorRow(tile.x, row, tile.width, &work.iters[i]);
+            i += tile.width;
+        }
+    } else {
+        //each pixel of the pass colors a block the size of the pass, up to
+        //the edge of the tile, until the next pass gets to the rest of it
+        for (i = 0; i < count; i++) {
+            int column = tile.x + work.pending[i] % tile.width;
+            int row = tile.y + work.pending[i] / tile.width;
+            iterations.set(column, row, work.iters[i]);
+            uint32_t color = colorOf(work.iters[i]);
+            int right = std::min(column + pass_step, tile.x + tile.width);
+            int bottom = std::min(row + pass_step, tile.y + tile.height);
+            for (int y = row; y < bottom; y++) {
+                for (int x = column; x < right; x++) {
+                    framebuffer.set(x, y, color);
+                }
+            }
+        }
+    }
+    if (profiling) work.color_seconds += color_clock.getElapsedTime().asSeconds();
+
+    //save where the pixels that didn't escape got to. The filled in ones were
+    //never iterated, so they start over from c
+    ResumeState& state = resume[tileIndex(tile)];
+    for (i = 0; i < count; i++) {
+        if (work.iters[i] < max_iter) continue;
+        bool filled = subdivided && work.known[i] == 2;
+        state.pixel.push_back(whole ? i : work.pending[i]);
+        state.zx.push_back(filled ? work.cx[i] : work.zx[i]);
+        state.zy.push_back(filled ? work.cy[i] : work.zy[i]);
+        state.iters.push_back(filled ? 0 : work.iters[i]);
+    }
+}
+
+//true if every pixel on the border of the rectangle has the same escape time
+static bool uniformBorder(const int *iters, int stride, int x0, int y0, int x1, int y1, int& value) {
+    value = iters[y0 * stride + x0];
+    for (int x = x0; x <= x1; x++) {
+        if (iters[y0 * stride + x] != value || iters[y1 * stride + x] != value) return false;
+    }
+    for (int y = y0; y <= y1; y++) {
+        if (iters[y * stride + x0] != value || iters[y * stride + x1] != value) return false;
+    }
+    return true;
+}
+
+//Mariani-Silver subdivision. The set is connected and has no holes, so the
+//points with escape times below n are connected to infinity, and the ones at n
+//or above to the set. A rectangle whose border is all n can then only have a
+//different escape time inside if the whole set is inside it, and with it 0.
+//Each level of rectangles gets its borders iterated in one batch, then the
+//uniform ones are filled and the rest split in four, sharing their borders
+void MandelbrotEngine::subdivideTile(const Tile& tile, WorkerScratch& work) {
+    int w = tile.width;
+    double x_inc = interpolate(area.width, width);
+    double y_inc = interpolate(area.height, height);
+    work.known.assign(tile.width * tile.height, 0);
+    work.rects.clear();
+    FillRect whole = {0, 0, tile.width - 1, tile.height - 1};
+    work.rects.push_back(whole);
+
+    while (!work.rects.empty()) {
+        //gather the borders, or the whole rectangle if it is too thin to have
+        //much of an inside
+        work.pending.clear();
+        for (size_t r = 0; r < work.rects.size(); r++) {
+            const FillRect& rect = work.rects[r];
+            bool small = rect.x1 - rect.x0 < 3 || rect.y1 - rect.y0 < 3;
+            for (int y = rect.y0; y <= rect.y1; y++) {
+                bool edge = small || y == rect.y0 || y == rect.y1;
+                int step = edge ? 1 : rect.x1 - rect.x0;
+                for (int x = rect.x0; x <= rect.x1; x += step) {
+                    int i = y * w + x;
+                    if (work.known[i]) continue;
+                    work.known[i] = 1;
+                    work.pending.push_back(i);
+                }
+            }
+        }
+        escapePending(work);
+        if (cancelled) return;
+
+        work.next_rects.clear();
+        for (size_t r = 0; r < work.rects.size(); r++) {
+            FillRect rect = work.rects[r];
+            if (rect.x1 - rect.x0 < 3 || rect.y1 - rect.y0 < 3) continue;
+
+            int value;
+            if (uniformBorder(&work.iters[0], w, rect.x0, rect.y0, rect.x1, rect.y1, value)) {
+                double left = grid_left + (tile.x + shift_x + rect.x0) * x_inc;
+                double right = grid_left + (tile.x + shift_x + rect.x1) * x_inc;
+                double top = grid_top + (tile.y + shift_y + rect.y0) * y_inc;
+                double bottom = grid_top + (tile.y + shift_y + rect.y1) * y_inc;
+                bool origin = left <= 0.0 && right >= 0.0 && top <= 0.0 && bottom >= 0.0;
+                if (value >= max_iter || !origin) {
+                    for (int y = rect.y0 + 1; y < rect.y1; y++) {
+                        for (int x = rect.x0 + 1; x < rect.x1; x++) {
+                            int i = y * w + x;
+                            work.iters[i] = value;
+                            work.known[i] = 2;
+                        }
+                    }
+                    work.filled += (long long) (rect.x1 - rect.x0 - 1) * (rect.y1 - rect.y0 - 1);
+                    continue;
+                }
+            }
+
+            int mx = (rect.x0 + rect.x1) / 2;
+            int my = (rect.y0 + rect.y1) / 2;
+            FillRect quarters[4] = {{rect.x0, rect.y0, mx, my}, {mx, rect.y0, rect.x1, my},
+                                    {rect.x0, my, mx, rect.y1}, {mx, my, rect.x1, rect.y1}};
+            work.next_rects.insert(work.next_rects.end(), quarters, quarters + 4);
+        }
+        work.rects.swap(work.next_rects);
+    }
+}
+
+//runs the pending pixels of a tile through the kernel as one batch
+void MandelbrotEngine::escapePending(WorkerScratch& work) {
+    int count = (int) work.pending.size();
+    if (count == 0) return;
+    if ((int) work.pending_iters.size() < count) {
+        work.pending_cx.resize(count);
+        work.pending_cy.resize(count);
+        work.pending_zx.resize(count);
+        work.pending_zy.resize(count);
+        work.pending_iters.resize(count);
+    }
+
+    for (int k = 0; k < count; k++) {
+        int i = work.pending[k];
+        work.pending_cx[k] = work.cx[i];
+        work.pending_cy[k] = work.cy[i];
+        work.pending_zx[k] = work.zx[i];
+        work.pending_zy[k] = work.zy[i];
+        work.pending_iters[k] = work.iters[i];
+    }
+    EscapeBatch batch = {&work.pending_cx[0], &work.pending_cy[0], &work.pending_zx[0],
+                         &work.pending_zy[0], &work.pending_iters[0], count, &cancelled};
+    tiers[tier]->escape(batch, max_iter, work.stats);
+    work.pixels += count;
+
+    for (int k = 0; k < count; k++) {
+        int i = work.pending[k];
+        work.zx[i] = work.pending_zx[k];
+        work.zy[i] = work.pending_zy[k];
+        work.iters[i] = work.pending_iters[k];
+    }
+}
+
+//continues the pixels of a tile that hadn't escaped at last_max_iter. The ones
+//that escaped already have their final escape time, so they are skipped
+void MandelbrotEngine::resumeTile(const Tile& tile, int worker) {
+    WorkerScratch& work = scratch[worker];
+    ResumeState& state = resume[tileIndex(tile)];
+    int count = (int) state.pixel.size();
+    if (count == 0) return;
+
+    double x_inc = interpolate(area.width, width);
+    double y_inc = interpolate(area.height, height);
+    reserveScratch(work, count);
+
+    //a pixel that escaped on exactly the last iteration already has its final
+    //escape time, it just isn't black anymore. The rest go to the kernel
+    int pending = 0;
+    for (int i = 0; i < count; i++) {
+        int column = tile.x + state.pixel[i] % tile.width;
+        int row = tile.y + state.pixel[i] / tile.width;
+        double x = state.zx[i];
+        double y = state.zy[i];
+        if (state.iters[i] == last_max_iter && x*x + y*y > 4.0) {
+            colorPixel(column, row, last_max_iter);
+            continue;
+        }
+        state.pixel[pending] = state.pixel[i];
+        work.cx[pending] = grid_left + (column + shift_x) * x_inc;
+        work.cy[pending] = grid_top + (row + shift_y) * y_inc;
+        work.zx[pending] = x;
+        work.zy[pending] = y;
+        work.iters[pending] = state.iters[i];
+        pending++;
+    }
+    count = pending;
+
+    EscapeBatch batch = {&work.cx[0], &work.cy[0], &work.zx[0], &work.zy[0], &work.iters[0], count,
+                         &cancelled};
+    tiers[tier]->escape(batch, max_iter, work.stats);
+    work.pixels += count;
+    if (cancelled) return;
+
+    //write the new escape times, and keep the pixels that still didn't escape
+    int remaining = 0;
+    for (int i = 0; i < count; i++) {
+        int column = tile.x + state.pixel[i] % tile.width;
+        int row = tile.y + state.pixel[i] / tile.width;
+        iterations.set(column, row, work.iters[i]);
+        colorPixel(column, row, work.iters[i]);
+        if (work.iters[i] < max_iter) continue;
+        state.pixel[remaining] = state.pixel[i];
+        state.zx[remaining] = work.zx[i];
+        state.zy[remaining] = work.zy[i];
+        state.iters[remaining] = work.iters[i];
+        remaining++;
+    }
+    state.pixel.resize(remaining);
+    state.zx.resize(remaining);
+    state.zy.resize(remaining);
+    state.iters.resize(remaining);
+}
+
+//lowers the escape times of a tile to the new max_iter, which is exactly what
+//generating it again would give
+void MandelbrotEngine::clampTile(const Tile& tile) {
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        for (int column = tile.x; column < tile.x + tile.width; column++) {
+            if (iterations.get(column, row) <= max_iter) continue;
+            iterations.set(column, row, max_iter);
+            colorPixel(column, row, max_iter);
+        }
+    }
+}
+
+//the tiles are in scanline order, so the index follows from the position
+int MandelbrotEngine::tileIndex(const Tile& tile) {
+    int across = (width + tile_offset_x + tile_size - 1) / tile_size;
+    return ((tile.y + tile_offset_y) / tile_size) * across + (tile.x + tile_offset_x) / tile_size;
+}
+
+bool MandelbrotEngine::isKept(const Tile& tile) {
+    return kept_step == 1 && tile.x >= kept.left && tile.y >= kept.top &&
+           tile.x + tile.width <= kept.left + kept.width &&
+           tile.y + tile.height <= kept.top + kept.height;
+}
+
+//the tiles cut short at the edges of the image can't be cached, the next view
+//might need the rest of them
+bool MandelbrotEngine::cacheKey(const Tile& tile, TileKey& key) {
+    if (tile.width != tile_size || tile.height != tile_size) return false;
+    key.grid = grid_hash;
+    key.level = grid_level;
+    key.x = ((long long) tile.x + shift_x) / tile_size;
+    key.y = ((long long) tile.y + shift_y) / tile_size;
+    key.max_iter = max_iter;
+    key.precision = tier;
+    key.approximations = 0;
+    if (subdivision) key.approximations |= TILE_SUBDIVIDED;
+    if (tier == PRECISION_PERTURBATION && getSeriesApproximation()) key.approximations |= TILE_SERIES;
+    return true;
+}
+
+//the tiles in the store are read straight out of the file it is mapped from,
+//and put in the cache so the next time they're found there
+void MandelbrotEngine::findTile(const Tile& tile, int worker) {
+    TileKey key;
+    if (!cacheKey(tile, key)) return;
+    WorkerScratch& work = scratch[worker];
+    int count = tile.width * tile.height;
+    reserveScratch(work, count);
+
+    int i = 0;
+    if (cache.getBudget() > 0 && cache.find(key, &work.iters[0], count)) {
+        for (int row = tile.y; row < tile.y + tile.height; row++) {
+            iterations.setRow(tile.x, row, tile.width, &work.iters[i]);
+            colorRow(tile.x, row, tile.width, &work.iters[i]);
+            i += tile.width;
+        }
+        cache_hits[tileIndex(tile)] = TILE_CACHED;
+        work.cached += count;
+        return;
+    }
+
+    const uint32_t *stored = store.isOpen() && store.getTileSize() == tile_size ? store.find(key) : NULL;
+    if (stored == NULL) return;
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        for (int column = tile.x; column < tile.x + tile.width; column++) {
+            int iter = (int) stored[i];
+            work.iters[i++] = iter;
+            iterations.set(column, row, iter);
+            colorPixel(column, row, iter);
+        }
+    }
+    if (cache.getBudget() > 0) cache.insert(key, &work.iters[0], count);
+    cache_hits[tileIndex(tile)] = TILE_LOADED;
+    work.loaded += count;
+}
+
+//called by the worker as soon as it finishes a tile, so that a render that is
+//cut short still leaves its tiles in the store
+void MandelbrotEngine::storeTile(const Tile& tile, int worker) {
+    TileKey key;
+    if (cache_hits[tileIndex(tile)] != TILE_MISSING || !cacheKey(tile, key)) return;
+    WorkerScratch& work = scratch[worker];
+    int count = tile.width * tile.height;
+    reserveScratch(work, count);
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        iterations.getRow(tile.x, row, tile.width, &work.iters[(row - tile.y) * tile.width]);
+    }
+    if (cache.getBudget() > 0) cache.insert(key, &work.iters[0], count);
+    if (store.isOpen() && store.getTileSize() == tile_size) store.insert(key, &work.iters[0]);
+}
+
+//runs on the thread that called generate(), while the workers are idle, so
+//it can use the first worker's scratch space to store the tiles
+long long MandelbrotEngine::farmTiles(std::vector<Tile>& missing, bool caching) {
+    if (farm == NULL || missing.empty()) return 0;
+    long long pixels = 0;
+    farm->render(getTileView(), missing, [this, caching, &pixels] (const Tile& tile, const int *iters) {
+        sf::Clock color_clock;
+        for (int row = 0; row < tile.height; row++) {
+            iterations.setRow(tile.x, tile.y + row, tile.width, iters + row * tile.width);
+            colorRow(tile.x, tile.y + row, tile.width, iters + row * tile.width);
+        }
+        if (profiling) scratch[0].color_seconds += color_clock.getElapsedTime().asSeconds();
+        markDirty(tile);
+        if (caching) storeTile(tile, 0);
+        cache_hits[tileIndex(tile)] = TILE_REMOTE;
+        pixels += tile.width * tile.height;
+    });
+    return pixels;
+}
+
+TileView MandelbrotEngine::getTileView() {
+    TileView view;
+    view.width = width;
+    view.height = height;
+    view.tile_size = tile_size;
+    view.tile_offset_x = tile_offset_x;
+    view.tile_offset_y = tile_offset_y;
+    view.area_width = area.width;
+    view.area_height = area.height;
+    view.origin_x = origin_x;
+    view.origin_y = origin_y;
+    view.shift_x = shift_x;
+    view.shift_y = shift_y;
+    view.grid_left = grid_left;
+    view.grid_top = grid_top;
+    view.origin_column = origin_column;
+    view.origin_row = origin_row;
+    view.max_iter = max_iter;
+    view.tier = tier;
+    view.subdivision = subdivision;
+    view.series = getSeriesApproximation();
+    return view;
+}
+
+//takes over the grid and tier of the view, and gets the tier ready the same
+//way generate() would. Nothing that was rendered before is kept
+void MandelbrotEngine::setTileView(const TileView& view) {
+    tile_size = view.tile_size;
+    tile_offset_x = view.tile_offset_x;
+    tile_offset_y = view.tile_offset_y;
+    area.width = view.area_width;
+    area.height = view.area_height;
+    origin_x = view.origin_x;
+    origin_y = view.origin_y;
+    shift_x = view.shift_x;
+    shift_y = view.shift_y;
+    grid_left = view.grid_left;
+    grid_top = view.grid_top;
+    origin_column = view.origin_column;
+    origin_row = view.origin_row;
+    moveCenter();
+    max_iter = last_max_iter = view.max_iter;
+    setSubdivision(view.subdivision);
+    setSeriesApproximation(view.series);
+
+    tier = view.tier;
+    tiers[tier]->prepare(origin_x, origin_y, interpolate(area.width, width), max_iter);
+    iterations.reserve(max_iter);
+    updateColors();
+    kept = sf::Rect<int>();
+    pass_step = pass_first = 1;
+    resume.clear();
+    resume.resize(makeTiles(width, height, tile_size, tile_offset_x, tile_offset_y).size());
+    resume_valid = false;
+    rendered = false;
+}
+
+//a tile can be asked for more than once, so its resume state starts over
+void MandelbrotEngine::generateTiles(const std::vector<Tile>& tiles, const TileDone& done) {
+    scheduler->run(tiles, [this] (const Tile& tile, int worker) {
+        resume[tileIndex(tile)] = ResumeState();
+        genTile(tile, worker);
+    });
+    std::vector<int> iters;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        const Tile& tile = tiles[i];
+        iters.resize((size_t) tile.width * tile.height);
+        for (int row = 0; row < tile.height; row++) {
+            iterations.getRow(tile.x, tile.y + row, tile.width, &iters[(size_t) row * tile.width]);
+        }
+        done(tile, &iters[0]);
+    }
+}
+
+//grows a worker's scratch space
+void MandelbrotEngine::reserveScratch(WorkerScratch& work, int count) {
+    if ((int) work.iters.size() >= count) return;
+    work.cx.resize(count);
+    work.cy.resize(count);
+    work.zx.resize(count);
+    work.zy.resize(count);
+    work.iters.resize(count);
+}
+
+//resets the mandelbrot to generate the starting area
+void MandelbrotEngine::resetMandelbrot() {
+    area.width = 2;
+    area.height = 2.0 * height / width;
+    setCenter(HighPrecision(-0.5, HighPrecision::max_limbs), HighPrecision(0.0, HighPrecision::max_limbs));
+    max_iter = 100;
+    last_max_iter = 100;
+    color_multiple = 1;
+    resume_valid = false;
+}
+
+//the framebuffer only has one dirty rectangle, which grows to cover every
+//tile that was drawn into. The workers mark their tiles as they finish them,
+//while another thread can be taking it, so it's behind a lock
+void MandelbrotEngine::markDirty(const Tile& tile) {
+    markDirty(sf::Rect<int>(tile.x, tile.y, tile.width, tile.height));
+}
+
+void MandelbrotEngine::markDirty(const sf::Rect<int>& rect) {
+    if (rect.width <= 0 || rect.height <= 0) return;
+    std::lock_guard<std::mutex> lock(dirty_mutex);
+    if (dirty.width <= 0 || dirty.height <= 0) {
+        dirty = rect;
+        return;
+    }
+    int left = std::min(dirty.left, rect.left);
+    int top = std::min(dirty.top, rect.top);
+    int right = std::max(dirty.left + dirty.width, rect.left + rect.width);
+    int bottom = std::max(dirty.top + dirty.height, rect.top + rect.height);
+    dirty = sf::Rect<int>(left, top, right - left, bottom - top);
+}
+
+sf::Rect<int> MandelbrotEngine::takeDirty() {
+    std::lock_guard<std::mutex> lock(dirty_mutex);
+    sf::Rect<int> taken = dirty;
+    dirty = sf::Rect<int>(0, 0, 0, 0);
+    return taken;
+}
+
+//the color of a heat from 0 to 1
+static sf::Color heatColor(double heat) {
+    heat = std::min(std::max(heat, 0.0), 1.0) * 3.0;
+    return sf::Color((sf::Uint8) (255 * std::min(heat, 1.0)),
+                     (sf::Uint8) (255 * std::min(std::max(heat - 1.0, 0.0), 1.0)),
+                     (sf::Uint8) (255 * std::max(heat - 2.0, 0.0)));
+}
+
+bool MandelbrotEngine::saveHeatmap(const std::string& filename, bool per_pixel) {
+    sf::Image image;
+    image.create(width, height, sf::Color::Black);
+    if (per_pixel) {
+        double scale = std::log(1.0 + std::max(max_iter, 1));
+        std::vector<int> row(width);
+        for (int y = 0; y < height; y++) {
+            iterations.getRow(0, y, width, &row[0]);
+            for (int x = 0; x < width; x++) {
+                image.setPixel(x, y, heatColor(std::log(1.0 + row[x]) / scale));
+            }
+        }
+        return image.saveToFile(filename);
+    }
+
+    //the tiles are scaled to the slowest one
+    if (profile.tiles.empty()) return false;
+    double slowest = *std::max_element(profile.tile_seconds.begin(), profile.tile_seconds.end());
+    for (size_t i = 0; i < profile.tiles.size(); i++) {
+        const Tile& tile = profile.tiles[i];
+        sf::Color color = heatColor(slowest > 0.0 ? profile.tile_seconds[i] / slowest : 0.0);
+        for (int y = tile.y; y < tile.y + tile.height; y++) {
+            for (int x = tile.x; x < tile.x + tile.width; x++) image.setPixel(x, y, color);
+        }
+    }
+    return image.saveToFile(filename);
+}
+
+void MandelbrotEngine::printProfile(std::ostream& out) {
+    if (!profiling) return;
+    double wall = 0.0;
+    double busy = 0.0;
+    for (size_t i = 0; i < profile.workers.size(); i++) {
+        const WorkerStats& worker = profile.workers[i];
+        out << "Worker " << i << ": " << worker.tiles << " tiles (" << worker.steals << " stolen), busy "
+            << worker.busy << "s, idle " << worker.wall - worker.busy << "s" << std::endl;
+        wall = std::max(wall, worker.wall);
+        busy += worker.busy;
+    }
+    if (wall > 0.0) {
+        out << "The workers were busy " << 100.0 * busy / (wall * profile.workers.size())
+            << "% of the time" << std::endl;
+    }
+    out << stats.kernel.iterations << " iterations, " << stats.kernel.interior + stats.kernel.periodic +
+           stats.filled << " pixels cut short (" << stats.kernel.interior << " interior, "
+        << stats.kernel.periodic << " periodic, " << stats.filled << " filled in), "
+        << stats.reused + stats.cached + stats.loaded << " not generated" << std::endl;
+    out << "Coloring took " << profile.color_seconds << "s over all the workers, copying "
+        << profile.copy_seconds << "s" << std::endl;
+}
+
+//saves the image to the given file
+bool MandelbrotEngine::saveImage(const std::string& filename) {
+    sf::Image image;
+    image.create(width, height, framebuffer.getPixels());
+    return image.saveToFile(filename);
+}
+
+//saves the image to a png with a timestamp in the title
+std::string MandelbrotEngine::saveImage() {
+    //set up the timestamp filename
+    time_t currentTime = time(0);
+    tm* currentDate = localtime(&currentTime);
+    char filename[80];
+    strftime(filename,80,"%Y-%m-%d.%H-%M-%S.png",currentDate);
+
+    saveImage(std::string(filename));
+    return filename;
+}
+
+//Converts a vector from pixel coordinates to the corresponding
+//coordinates on the complex plane
+sf::Vector2<double> MandelbrotEngine::pixelToComplex(sf::Vector2<double> pix) {
+    sf::Vector2<double> comp;
+    comp.x = area.left + pix.x * interpolate(area.width, width);
+    comp.y = area.top + pix.y * interpolate(area.height, height);
+    return comp;
+}
+
+//findColor uses the number of iterations passed to it to look up a color in the palette
+sf::Color MandelbrotEngine::findColor(int iter) {
+    int i = fmod(iter * color_multiple, 255);
+    sf::Color color;
+    if (iter >= max_iter) color = sf::Color::Black;
+    else {
+        color.r = palette[0][i];
+        color.g = palette[1][i];
+        color.b = palette[2][i];
+    }
+    return color;
+}
+
+//rebuilds the color table if anything it depends on has changed. It has to be
+//called before the workers color any pixels, since they share it
+void MandelbrotEngine::updateColors() {
+    if (colors_valid && colors_multiple == color_multiple && colors_max_iter == max_iter) return;
+    colors_valid = true;
+    colors_multiple = color_multiple;
+    colors_max_iter = max_iter;
+    colors.clear();
+    if (max_iter > color_limit) return;
+
+    //every escape time from max_iter on is black, so the table ends there. A
+    //big table takes a while, so a cancelled render leaves it for the next one
+    colors.resize(max_iter + 1);
+    for (int i = 0; i <= max_iter; i++) {
+        if (i % cancel_interval == 0 && cancelled) {
+            colors.clear();
+            colors_valid = false;
+            return;
+        }
+        colors[i] = packColor(findColor(i));
+    }
+}
+
+void MandelbrotEngine::colorRow(int x, int y, int count, const int *iters) {
+    uint32_t *pixels = framebuffer.getRow(y) + x;
+    if (colors.empty()) {
+        for (int i = 0; i < count; i++) pixels[i] = colorOf(iters[i]);
+    } else {
+        color_kernel(iters, count, &colors[0], (int) colors.size(), pixels);
+    }
+}
+
+void MandelbrotEngine::recolorTile(const Tile& tile, int worker) {
+    WorkerScratch& work = scratch[worker];
+    reserveScratch(work, tile.width);
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        iterations.getRow(tile.x, row, tile.width, &work.iters[0]);
+        colorRow(tile.x, row, tile.width, &work.iters[0]);
+    }
+}
+
+//a random number in [-0.5, 0.5) for each sample of each pixel of the grid,
+//which is the same every time so a view always gets the same jitter
+static double jitterOffset(long long column, long long row, int sample) {
+    uint64_t h = (uint64_t) column * 0x9E3779B97F4A7C15ULL ^ (uint64_t) row * 0xC2B2AE3D27D4EB4FULL ^
+                 (uint64_t) sample * 0x165667B19E3779F9ULL;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (h >> 11) * (1.0 / 9007199254740992.0) - 0.5;
+}
+
+//runs after the image is complete, since finding the edges needs the escape
+//times of the neighboring tiles. Only the colors change, the iteration buffer
+//keeps each pixel's own escape time
+void MandelbrotEngine::supersample() {
+    stats.edges = 0;
+    stats.samples = 0;
+    if (supersample_grid <= 1) return;
+    for (size_t i = 0; i < scratch.size(); i++) {
+        scratch[i].edges = 0;
+        scratch[i].samples = 0;
+    }
+    scheduler->run(makeTiles(width, height, tile_size), [this] (const Tile& tile, int worker) {
+        if (!cancelled) supersampleTile(tile, worker);
+    });
+    for (size_t i = 0; i < scratch.size(); i++) {
+        stats.edges += scratch[i].edges;
+        stats.samples += scratch[i].samples;
+    }
+    markDirty(sf::Rect<int>(0, 0, width, height));
+}
+
+//the samples of all the edge pixels of a tile go to the kernel as one batch
+void MandelbrotEngine::supersampleTile(const Tile& tile, int worker) {
+    WorkerScratch& work = scratch[worker];
+    work.pending.clear();
+    for (int row = tile.y; row < tile.y + tile.height; row++) {
+        for (int column = tile.x; column < tile.x + tile.width; column++) {
+            if (isEdge(column, row)) work.pending.push_back((row - tile.y) * tile.width + column - tile.x);
+        }
+    }
+    int edges = (int) work.pending.size();
+    if (edges == 0) return;
+
+    //the samples are spread evenly over the pixel, then jittered. The jitter
+    //is keyed by the pixel's place on the grid, so panning doesn't change it
+    int grid = supersample_grid;
+    int per_pixel = grid * grid;
+    int count = edges * per_pixel;
+    reserveScratch(work, count);
+    double x_inc = interpolate(area.width, width);
+    double y_inc = interpolate(area.height, height);
+    const PrecisionKernel *kernel = tiers[tier];
+    bool offsets = kernel->usesOffsets();
+    int i = 0;
+    for (int e = 0; e < edges; e++) {
+        int column = tile.x + work.pending[e] % tile.width;
+        int row = tile.y + work.pending[e] / tile.width;
+        for (int sample = 0; sample < per_pixel; sample++) {
+            double dx = ((sample % grid) + 0.5 + supersample_jitter *
+                         jitterOffset(column + shift_x, row + shift_y, 2 * sample)) / grid - 0.5;
+            double dy = ((sample / grid) + 0.5 + supersample_jitter *
+                         jitterOffset(column + shift_x, row + shift_y, 2 * sample + 1)) / grid - 0.5;
+            work.cx[i] = work.zx[i] = offsets ? (column + dx + shift_x - origin_column) * x_inc :
+                                                grid_left + (column + dx + shift_x) * x_inc;
+            work.cy[i] = work.zy[i] = offsets ? (row + dy + shift_y - origin_row) * y_inc :
+                                                grid_top + (row + dy + shift_y) * y_inc;
+            work.iters[i] = 0;
+            i++;
+        }
+    }
+    EscapeBatch batch = {&work.cx[0], &work.cy[0], &work.zx[0], &work.zy[0], &work.iters[0], count,
+                         &cancelled};
+    kernel->escape(batch, max_iter, work.stats);
+    if (cancelled) return;
+
+    //each edge pixel gets the average color of its samples
+    i = 0;
+    for (int e = 0; e < edges; e++) {
+        int sum[4] = {0, 0, 0, 0};
+        for (int sample = 0; sample < per_pixel; sample++) {
+            uint32_t rgba = colorOf(work.iters[i++]);
+            const uint8_t *bytes = (const uint8_t *) &rgba;
+            for (int c = 0; c < 4; c++) sum[c] += bytes[c];
+        }
+        uint8_t average[4];
+        for (int c = 0; c < 4; c++) average[c] = (uint8_t) ((sum[c] + per_pixel / 2) / per_pixel);
+        framebuffer.set(tile.x + work.pending[e] % tile.width, tile.y + work.pending[e] / tile.width,
+                        average[0], average[1], average[2], average[3]);
+    }
+    work.edges += edges;
+    work.samples += count;
+}
+
+//a neighbor only counts if its color is also far enough from the pixel's, so
+//the smooth bands away from the boundary aren't supersampled
+bool MandelbrotEngine::isEdge(int column, int row) {
+    int iter = iterations.get(column, row);
+    uint32_t rgba = colorOf(iter);
+    const uint8_t *color = (const uint8_t *) &rgba;
+    int top = std::max(row - 1, 0);
+    int bottom = std::min(row + 1, height - 1);
+    int left = std::max(column - 1, 0);
+    int right = std::min(column + 1, width - 1);
+    for (int y = top; y <= bottom; y++) {
+        for (int x = left; x <= right; x++) {
+            int other_iter = iterations.get(x, y);
+            if (other_iter == iter) continue;
+            uint32_t other_rgba = colorOf(other_iter);
+            const uint8_t *other = (const uint8_t *) &other_rgba;
+            int difference = std::abs(color[0] - other[0]) + std::abs(color[1] - other[1]) +
+                             std::abs(color[2] - other[2]);
+            if (difference > supersample_threshold) return true;
+        }
+    }
+    return false;
+}
+
+//This is for initPalette, it makes sure the given number is between 0 and 255
+int coerce(int number) {
+    if (number > 255) number = 255;
+    else if (number < 0) number = 0;
+    return number;
+}
+
+//Sets up the palette array
+void MandelbrotEngine::initPalette() {
+    colors_valid = false;
+    //scheme one is black:blue:white:orange:black
+    if (scheme == 1) {
+        sf::Color orange;
+        orange.r = 255;
+        orange.g = 165;
+        orange.b = 0;
+        smoosh(sf::Color::Black, sf::Color::Blue, 0, 64);
+        smoosh(sf::Color::Blue, sf::Color::White, 64, 144);
+        smoosh(sf::Color::White, orange, 144, 196);
+        smoosh(orange, sf::Color::Black, 196, 256);
+    } else if (scheme == 2) {
+        smoosh(sf::Color::Black, sf::Color::Green, 0, 85);
+        smoosh(sf::Color::Green, sf::Color::Blue, 85, 170);
+        smoosh(sf::Color::Blue, sf::Color::Black, 170, 256);
+    } else if (scheme == 3) {
+        smoosh(sf::Color::Red, sf::Color::Red, 0, 200);
+        smoosh(sf::Color::Red, sf::Color::Black, 200, 256);
+    } else {
+        int r, g, b;
+        for (int i = 0; i <= 255; i++) {
+            r = (int) (23.45 - 1.880*i + 0.0461*i*i - 0.000152*i*i*i);
+            g = (int) (17.30 - 0.417*i + 0.0273*i*i - 0.000101*i*i*i);
+            b = (int) (25.22 + 7.902*i - 0.0681*i*i + 0.000145*i*i*i);
+
+            palette[0][i] = coerce(r);
+            palette[1][i] = coerce(g);
+            palette[2][i] = coerce(b);
+        }
+    }
+}
+
+//Smooshes two colors together, and writes them to the palette in the specified range
+void MandelbrotEngine::smoosh(sf::Color c1, sf::Color c2, int min, int max) {
+    int range = max-min;
+    float r_inc = interpolate(c1.r, c2.r, range);
+    float g_inc = interpolate(c1.g, c2.g, range);
+    float b_inc = interpolate(c1.b, c2.b, range);
+
+    //loop through the palette setting new colors
+    for (int i=0; i < range; i++) {
+        palette[0][min+i] = (int) (c1.r + i * r_inc);
+        palette[1][min+i] = (int) (c1.g + i * g_inc);
+        palette[2][min+i] = (int) (c1.b + i * b_inc);
+    }
+}
@@ -0,0 +1,588 @@
+#ifndef MANDELBROTENGINE_H
+#define MANDELBROTENGINE_H
+
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mandelbrotBuffer.h"
+#include "mandelbrotHighPrecision.h"
+#include "mandelbrotKernels.h"
+#include "mandelbrotPerturbation.h"
+#include "mandelbrotPrecision.h"
+#include "mandelbrotScheduler.h"
+#include "mandelbrotTileCache.h"
+#include "mandelbrotTileStore.h"
+
+//statistics about the last call to generate(). pixels is the number that were
+//iterated, filled the number that subdivision filled in without iterating,
+//reused the number kept from the last render, cached the number taken from
+//the tile cache, loaded the number read from the tile store and remote the
+//number that came back from the tile farm. first_pass is when the first
+//progressive pass was ready. series_saved estimates the time the skipped
+//iterations would have taken, at this render's speed
+struct RenderStats {
+    double seconds;
+    double first_pass;
+    long long pixels;
+    long long filled;
+    long long reused;
+    long long cached;
+    long long loaded;
+    long long remote;
+    long long edges;
+    long long samples;
+    KernelStats kernel;
+    double series_saved;
+};
+
+//where the last render spent its time, when profiling is on. workers has what
+//each worker thread did (see WorkerStats). color_seconds is the time the
+//workers spent coloring pixels and copy_seconds the time spent moving the kept
+//pixels for the pans and zoom steps before it. Each tile of the render has the
+//time spent on it and the iterations it took, in the order of tiles
+struct RenderProfile {
+    std::vector<WorkerStats> workers;
+    double color_seconds;
+    double copy_seconds;
+    std::vector<Tile> tiles;
+    std::vector<double> tile_seconds;
+    std::vector<long long> tile_iterations;
+};
+
+//everything another engine needs to generate tiles exactly the way this one
+//would: the size of the image and how it's split into tiles, the grid the view
+//is on (see the grid members of MandelbrotEngine) and how the pixels are
+//iterated
+struct TileView {
+    int width;
+    int height;
+    int tile_size;
+    int tile_offset_x;
+    int tile_offset_y;
+    double area_width;
+    double area_height;
+    HighPrecision origin_x;
+    HighPrecision origin_y;
+    int shift_x;
+    int shift_y;
+    double grid_left;
+    double grid_top;
+    double origin_column;
+    double origin_row;
+    int max_iter;
+    PrecisionTier tier;
+    bool subdivision;
+    bool series;
+};
+
+//the function that gets the escape times of a tile that was generated
+//somewhere else, row after row
+typedef std::function<void (const Tile&, const int *)> TileDone;
+
+//TileFarm generates tiles somewhere else than the engine's workers, like in
+//other processes. generate() gives it the tiles that it's missing, and it
+//calls done with each one that comes back, from the thread that called
+//render(). The tiles it couldn't get done are left in tiles, and the engine
+//generates those itself
+class TileFarm {
+    public:
+        virtual ~TileFarm() {}
+        virtual void render(const TileView& view, std::vector<Tile>& tiles, const TileDone& done) = 0;
+};
+
+//MandelbrotEngine does all of the work of generating and coloring the mandelbrot.
+//It has no window, so it can be used for headless rendering as well as by the
+//interactive viewer
+class MandelbrotEngine {
+    public:
+        //This constructor creates a new engine that renders width x height pixels,
+        //with the given number of worker threads (0 means one per hardware thread)
+        MandelbrotEngine(int width, int height, int threads = 0);
+        ~MandelbrotEngine();
+
+        //the engine owns its worker threads, so it can't be copied
+        MandelbrotEngine(const MandelbrotEngine&) = delete;
+        MandelbrotEngine& operator=(const MandelbrotEngine&) = delete;
+
+        //Accesor functions:
+        int getWidth() {return width;}
+        int getHeight() {return height;}
+        int getIterations() {return max_iter;}
+        double getColorMultiple() {return color_multiple;}
+        int getColorScheme() {return scheme;}
+        sf::Rect<double> getArea() {return area;}
+        sf::Vector2<double> getMandelbrotCenter();
+        const HighPrecision& getCenterX() {return center_x;}
+        const HighPrecision& getCenterY() {return center_y;}
+        const PixelBuffer& getFramebuffer() {return framebuffer;}
+        const IterationBuffer& getIterationBuffer() {return iterations;}
+        KernelType getKernel() {return kernel_type;}
+        bool getLaneRefill() {return lane_refill;}
+        int getThreads() {return scheduler->getThreads();}
+        int getTileSize() {return tile_size;}
+        const RenderStats& getStats() {return stats;}
+        const RenderProfile& getProfile() {return profile;}
+        bool getProfiling() {return profiling;}
+        bool getSubdivision() {return subdivision;}
+        bool getProgressive() {return progressive;}
+        size_t getCacheBudget() {return cache.getBudget();}
+        CacheStats getCacheStats() {return cache.getStats();}
+        StoreStats getStoreStats() {return store.getStats();}
+        const ReferenceOrbit& getReferenceOrbit() {return perturbation_kernel.getOrbit();}
+        TileView getTileView();
+
+        //returns the precision tier the current view is rendered with
+        PrecisionTier getPrecision();
+
+        //Setter functions:
+        void setIterations(int iter) {max_iter = iter;}
+        void setColorMultiple(double mult) {color_multiple = mult;}
+        void setColorScheme(int newScheme) {scheme = newScheme; initPalette();}
+
+        //forces a specific escape kernel, returns false if this cpu can't run it
+        bool setKernel(KernelType type);
+
+        //switches between the lane-refilling and pairwise vector kernels
+        void setLaneRefill(bool refill) {lane_refill = refill; setKernel(kernel_type);}
+
+        //restarts the worker pool with a different number of threads
+        void setThreads(int threads);
+
+        //sets the size of the square tiles the workers generate
+        void setTileSize(int size) {tile_size = size; resume_valid = false; cache.clear();}
+
+        //turns Mariani-Silver subdivision on or off. With it, a rectangle whose
+        //border all has the same escape time is filled in without iterating
+        //its inside. It is only exact for the continuous plane: a filament
+        //thinner than a pixel can slip between the border pixels
+        void setSubdivision(bool enable) {subdivision = enable;}
+
+        //turns progressive rendering on or off. A progressive render iterates
+        //every 8th pixel of every 8th row first, then fills in every 4th, 2nd
+        //and finally every pixel, each pixel only once. The image shows each
+        //pixel as a block the size of its pass until the finer passes get to
+        //it. Subdivision isn't used for progressive renders
+        void setProgressive(bool enable) {progressive = enable;}
+
+        //turns profiling of the renders on or off (see RenderProfile). It times
+        //every tile, so it's left off unless it's needed
+        void setProfiling(bool enable);
+
+        //turns adaptive supersampling on or off. After each render, and each
+        //change of colors, the pixels whose escape time differs from one of
+        //their neighbors are colored again with the average of grid x grid
+        //samples. jitter moves each sample by up to that fraction of the
+        //spacing of the samples, randomly but the same every time. A neighbor
+        //only makes a pixel an edge if their colors differ by more than
+        //threshold, summed over red, green and blue. A grid of 1 turns it off
+        void setSupersampling(int grid, double jitter, int threshold = 0) {
+            supersample_grid = grid;
+            supersample_jitter = jitter;
+            supersample_threshold = threshold;
+        }
+
+        //the function generate() calls after each progressive pass, with the
+        //pass's pixel spacing. It is called from the thread that called
+        //generate(), while the workers are idle
+        typedef std::function<void (int)> PassFunction;
+        void setPassFunction(const PassFunction& function) {pass_function = function;}
+
+        //sets how many bytes of escape times the tile cache can keep. The tiles
+        //are laid out on the grid, so going back to a view that was generated
+        //before takes its tiles from the cache. 0 turns the cache off
+        void setCacheBudget(size_t bytes) {cache.setBudget(bytes);}
+        void clearCache() {cache.clear();}
+
+        //opens a tile store on disk that keeps the tiles between runs, like a
+        //cache without a budget. It is made with room for capacity tiles if the
+        //file doesn't exist yet. Returns false if it can't be opened, or was
+        //made with another tile size
+        bool openStore(const std::string& path, size_t capacity) {return store.open(path, tile_size, capacity);}
+        void closeStore() {store.close();}
+
+        //forces a precision tier, PRECISION_AUTO picks one from the zoom. The
+        //float tier is only used up to a max_iter of float_max_iter, doubles
+        //after that. Returns false if this build can't use the tier
+        bool setPrecision(PrecisionTier tier);
+
+        //turns series approximation on or off for perturbation renders
+        void setSeriesApproximation(bool enable) {perturbation_kernel.setSeriesApproximation(enable);}
+        bool getSeriesApproximation() {return perturbation_kernel.getSeriesApproximation();}
+
+        //hands the tiles of whole renders to a farm to generate, as long as they
+        //aren't progressive. The engine doesn't own it, and NULL turns it off
+        void setTileFarm(TileFarm *tile_farm) {farm = tile_farm;}
+
+        //Functions to change parameters for mandelbrot generation:
+        void changeColor();
+        void changePos(sf::Vector2<double> new_center, double zoom_factor);
+
+        //like changePos, but the new center is given in pixel coordinates, so it
+        //is exact at any zoom
+        void changePosPixel(sf::Vector2<double> new_center, double zoom_factor);
+
+        //moves the view dx pixels right and dy pixels down. The pixels that stay
+        //in view are moved along with it, so the next generate() only has to
+        //generate the ones that came into view
+        void panPixels(int dx, int dy);
+
+        //zooms in or out by exactly 2 around the middle of the view. The grid
+        //only gets finer or coarser, so the next generate() keeps the pixels
+        //of the last render that are still on it
+        void zoomStep(bool zoom_in);
+
+        //sets the center without rounding it to doubles. The string version takes
+        //decimal numbers with as many digits as needed, and returns false if they
+        //can't be read
+        void setCenter(const HighPrecision& x, const HighPrecision& y);
+        bool setCenter(const std::string& x, const std::string& y);
+
+        //Functions to generate the mandelbrot. If only max_iter went up since the
+        //last call, generate() just continues the pixels that hadn't escaped.
+        //It returns false if it was cancelled
+        bool generate();
+
+        //stops a generate() that is running on another thread. The workers
+        //notice within a few thousand iterations, so it returns soon after at
+        //any max_iter, with only the tiles it finished in the image. Those
+        //still go to the tile cache, and the pixels kept from a pan are still
+        //kept, but the next generate() otherwise starts over. A cancel() before
+        //generate() starts is lost, so the caller has to keep cancelling until
+        //it returns
+        void cancel() {cancelled = true;}
+
+        //resets the mandelbrot to generate the starting area
+        void resetMandelbrot();
+
+        //for the workers of a tile farm: setTileView() puts the engine on the
+        //view of another engine, which has to be the same size as this one.
+        //generateTiles() then generates just the given tiles of it, and calls
+        //done with the escape times of each one, giving exactly what the other
+        //engine would have
+        void setTileView(const TileView& view);
+        void generateTiles(const std::vector<Tile>& tiles, const TileDone& done);
+
+        //saves the image to the given file, the format is chosen by the extension.
+        //Without a filename it saves to a png with a timestamp in the title, and
+        //returns the name it used
+        bool saveImage(const std::string& filename);
+        std::string saveImage();
+
+        //saves a heatmap of where the last render spent its time, from black
+        //through red and yellow to white. Per tile it's the time spent on each
+        //tile, which needs profiling to be on, per pixel it's each pixel's escape
+        //time on a log scale
+        bool saveHeatmap(const std::string& filename, bool per_pixel);
+
+        //prints the profile of the last render
+        void printProfile(std::ostream& out);
+
+        //returns the part of the framebuffer that changed since the last call,
+        //so that only that much has to be uploaded to a texture. Each tile is
+        //added as soon as it's done, so another thread can take it while
+        //generate() is running and show the render as it goes
+        sf::Rect<int> takeDirty();
+
+        //Converts a vector from pixel coordinates to the corresponding
+        //coordinates of the complex plane
+        sf::Vector2<double> pixelToComplex(sf::Vector2<double>);
+
+    private:
+        int width;
+        int height;
+
+        //a rectangle of a tile for subdivision, the corners are included
+        struct FillRect {
+            int x0, y0, x1, y1;
+        };
+
+        //the worker threads, and the scratch space each one uses for a tile.
+        //Subdivision gathers the pixels it needs from the tile into the
+        //pending arrays, known says which pixels of the tile are done
+        struct WorkerScratch {
+            std::vector<double> cx;
+            std::vector<double> cy;
+            std::vector<double> zx;
+            std::vector<double> zy;
+            std::vector<int> iters;
+            std::vector<int> pending;
+            std::vector<double> pending_cx;
+            std::vector<double> pending_cy;
+            std::vector<double> pending_zx;
+            std::vector<double> pending_zy;
+            std::vector<int> pending_iters;
+            std::vector<char> known;
+            std::vector<FillRect> rects;
+            std::vector<FillRect> next_rects;
+            long long pixels;
+            long long filled;
+            long long cached;
+            long long loaded;
+            long long edges;
+            long long samples;
+            double color_seconds;
+            KernelStats stats;
+        };
+        TileScheduler *scheduler;
+        std::vector<WorkerScratch> scratch;
+        int tile_size;
+        bool subdivision;
+
+        //profiling is on while profile is being filled in, copy_seconds adds
+        //up the copying until the next render
+        bool profiling;
+        RenderProfile profile;
+        double copy_seconds;
+
+        //times a tile for the profile, from before it's started until after
+        //it's done
+        struct TileTimer {
+            sf::Clock clock;
+            long long iterations;
+        };
+        void startTile(TileTimer& timer, int worker) {
+            if (!profiling) return;
+            timer.iterations = scratch[worker].stats.iterations;
+            timer.clock.restart();
+        }
+        void finishTile(const Tile& tile, int worker, const TileTimer& timer);
+
+        //the grid of samples per pixel, their jitter and the color difference
+        //that makes an edge for supersampling
+        int supersample_grid;
+        double supersample_jitter;
+        int supersample_threshold;
+
+        //progressive rendering. pass_step is the spacing of the pixels of the
+        //pass the workers are generating, and pass_first the first pass's
+        bool progressive;
+        int pass_step;
+        int pass_first;
+        PassFunction pass_function;
+
+        //the colored image, which is updated by generate() and changeColor().
+        //dirty is the part that changed since takeDirty() was last called
+        PixelBuffer framebuffer;
+        sf::Rect<int> dirty;
+        std::mutex dirty_mutex;
+
+        //set by cancel() to stop the render in progress, the workers and the
+        //kernels check it
+        std::atomic<bool> cancelled;
+
+        //Parameters to generate the mandelbrot:
+
+        //this is the area of the complex plane to generate. The center is kept in
+        //high precision, area is the same view rounded to doubles
+        sf::Rect<double> area;
+        HighPrecision center_x;
+        HighPrecision center_y;
+
+        //the view is a window onto a grid of pixels around origin_x, origin_y.
+        //Panning only moves the window by shift_x, shift_y pixels, so the pixels
+        //that stay in view keep exactly the same coordinates. grid_left and
+        //grid_top are the corner of the grid, and origin_column, origin_row
+        //where the origin is on it. Zooming by 2 scales the grid and these
+        //along with it, which leaves the coordinates of the old pixels exact
+        HighPrecision origin_x;
+        HighPrecision origin_y;
+        int shift_x;
+        int shift_y;
+        double grid_left;
+        double grid_top;
+        double origin_column;
+        double origin_row;
+
+        //kept is the part of the image that is still valid after panning or
+        //zooming, where every kept_step-th pixel from its corner was kept. It
+        //is empty unless the view moved since the last render. rendered is
+        //true while the image is complete for the current view
+        sf::Rect<int> kept;
+        int kept_step;
+        bool rendered;
+
+        //the furthest the window can move from the grid's corner, in pixels
+        static const int max_shift = 1 << 24;
+
+        //the tile cache and store are keyed by the grid the view is on. Every
+        //grid that was started from updateArea() has a hash of where its origin
+        //is and the size of its area and image, grid_level counts the zoom
+        //steps since then. The tiles are lined up with the grid, so the first
+        //column and row of them are cut short by tile_offset_x, tile_offset_y
+        //pixels. cache_hits says where each tile was found
+        uint64_t grid_hash;
+        int grid_level;
+        int tile_offset_x;
+        int tile_offset_y;
+        TileCache cache;
+        TileStore store;
+        std::vector<char> cache_hits;
+        enum {TILE_MISSING = 0, TILE_CACHED = 1, TILE_LOADED = 2, TILE_REMOTE = 3};
+
+        //the farm that generates tiles for the engine, if there is one
+        TileFarm *farm;
+
+
+        //this changes how the colors are displayed
+        double color_multiple;
+        int scheme;
+
+        //this buffer stores the number of iterations for each pixel
+        IterationBuffer iterations;
+
+        //maximum number of iterations to check for. Higher values are slower,
+        //but more precise
+        int max_iter;
+
+        //the max_iter the iteration buffer was generated with
+        int last_max_iter;
+
+        //the pixels of each tile that reached last_max_iter without escaping, and
+        //their final z. Raising max_iter continues just these pixels, as long as
+        //the view hasn't changed since. iters is the iteration each z is at,
+        //which is 0 for pixels that subdivision filled in
+        struct ResumeState {
+            std::vector<int> pixel;
+            std::vector<double> zx;
+            std::vector<double> zy;
+            std::vector<int> iters;
+        };
+        std::vector<ResumeState> resume;
+        bool resume_valid;
+
+        //the escape kernel to use, picked at startup according to the cpu
+        KernelType kernel_type;
+        bool lane_refill;
+
+        //the kernels for each precision tier. precision is the tier that was
+        //asked for, tier is the one used for the last render
+        VectorKernel float_kernel;
+        VectorKernel double_kernel;
+        DoubleDoubleKernel double_double_kernel;
+        QuadKernel quad_kernel;
+        PerturbationKernel perturbation_kernel;
+        PrecisionKernel *tiers[PRECISION_AUTO];
+        PrecisionTier precision;
+        PrecisionTier tier;
+
+        //statistics for the last render, the worker threads add to them
+        RenderStats stats;
+
+        //Functions:
+
+        //interpolate returns the increment to get from min to max in range iterations
+        double interpolate(double min, double max, int range) {return (max-min)/range;}
+        double interpolate(double length, int range) {return length/range;}
+
+        //recalculates area from the center and the size of the area, and puts
+        //the grid's origin there
+        void updateArea();
+        void moveCenter();
+
+        //genTile is the function for worker threads: it generates the pixels of
+        //one tile that are in the current pass, using the scratch space of the
+        //given worker
+        void genTile(const Tile& tile, int worker);
+
+        //supersample() colors the edge pixels of the whole image again from
+        //several samples each, supersampleTile is the worker function for it
+        void supersample();
+        void supersampleTile(const Tile& tile, int worker);
+
+        //true if the pixel's escape time differs from any of its neighbors'
+        bool isEdge(int column, int row);
+
+        //true if the pixel is generated by the current pass, and wasn't kept
+        bool needsPixel(int column, int row) {
+            if (column >= kept.left && column < kept.left + kept.width &&
+                row >= kept.top && row < kept.top + kept.height &&
+                (column - kept.left) % kept_step == 0 && (row - kept.top) % kept_step == 0) return false;
+            if (column % pass_step != 0 || row % pass_step != 0) return false;
+            return pass_step == pass_first || column % (2 * pass_step) != 0 || row % (2 * pass_step) != 0;
+        }
+
+        //subdivideTile generates a tile that genTile set up by Mariani-Silver
+        //subdivision, and escapePending iterates the pixels it gathered
+        void subdivideTile(const Tile& tile, WorkerScratch& work);
+        void escapePending(WorkerScratch& work);
+
+        //resumeTile continues the unescaped pixels of a tile up to the new max_iter,
+        //and clampTile lowers escape times in a tile to a smaller max_iter
+        void resumeTile(const Tile& tile, int worker);
+        void clampTile(const Tile& tile);
+
+        //returns the index of a tile in the resume list
+        int tileIndex(const Tile& tile);
+
+        //true if every pixel of the tile was kept
+        bool isKept(const Tile& tile);
+
+        //cacheKey finds the key of a tile, if it's a whole one. findTile copies
+        //a tile out of the cache or the store if it is there, and storeTile
+        //copies one that was generated into them
+        bool cacheKey(const Tile& tile, TileKey& key);
+        void findTile(const Tile& tile, int worker);
+        void storeTile(const Tile& tile, int worker);
+
+        //hands the missing tiles to the farm, and takes the ones that come back
+        //the same way as the ones found in the cache. The ones it couldn't do
+        //are left in missing. Returns the number of pixels it did
+        long long farmTiles(std::vector<Tile>& missing, bool caching);
+
+        //makes sure a worker's scratch space can hold count pixels
+        void reserveScratch(WorkerScratch& work, int count);
+
+        //This looks up a color to print according to the escape value given
+        sf::Color findColor(int iter);
+
+        //the packed color of every escape time up to max_iter, so the workers
+        //don't have to work them out for each pixel. updateColors() rebuilds it
+        //when the palette, color_multiple or max_iter have changed since. It is
+        //left empty for a max_iter above color_limit, and findColor is used instead
+        std::vector<uint32_t> colors;
+        double colors_multiple;
+        int colors_max_iter;
+        bool colors_valid;
+        ColorKernel color_kernel;
+        static const int color_limit = 1 << 24;
+        void updateColors();
+
+        //the packed color of an escape time, in the framebuffer's byte order
+        uint32_t colorOf(int iter) {
+            return (size_t) iter < colors.size() ? colors[iter] : packColor(findColor(iter));
+        }
+        static uint32_t packColor(sf::Color color) {
+            uint8_t bytes[4] = {color.r, color.g, color.b, color.a};
+            uint32_t rgba;
+            memcpy(&rgba, bytes, sizeof(rgba));
+            return rgba;
+        }
+
+        //colors one pixel, or count pixels of a row starting at x, of the
+        //framebuffer from their escape times
+        void colorPixel(int x, int y, int iter) {framebuffer.set(x, y, colorOf(iter));}
+        void colorRow(int x, int y, int count, const int *iters);
+
+        //colors a tile of the framebuffer again from the iteration buffer
+        void recolorTile(const Tile& tile, int worker);
+
+        //colors one pixel of the framebuffer
+        void setPixel(int x, int y, sf::Color color) {framebuffer.set(x, y, color.r, color.g, color.b, color.a);}
+
+        //adds a tile, or a rectangle, to the dirty part of the image
+        void markDirty(const Tile& tile);
+        void markDirty(const sf::Rect<int>& rect);
+
+        //initialize the color palette. Having a palette helps avoid regenerating the
+        //color scheme each time it is needed
+        int palette[3][256];
+        void initPalette();
+        void smoosh(sf::Color c1, sf::Color c2, int min, int max);
+};
+
+#endif
@@ -2,8 +2,7 @@
 #include <iostream>
 
 
-//this struct holds the parameters for the zoom function,
-//since it needs to be threaded and cannot accept arguments
+//this struct holds the parameters for the zoom function
 struct zoomParameters {
     MandelbrotViewer *viewer;
     sf::Vector2f oldc;
@@ -31,46 +30,29 @@ void zoom() {
     }
 }
 
-int main(int argc, char **argv) {
-    if (argc > 2) {
-        std::cout << "Doing a fixed test - remember to time!" << std::endl;
-        std::cout << "Also remember to call like: " << argv[0] << " <#iterations> <zoom factor>" << std::endl;
-        MandelbrotViewer brot(1024);
-        brot.resetMandelbrot();
-        brot.setIterations(atoi(argv[1]));
-        sf::Vector2<double> new_pos;
-        new_pos.x = 0.013438870532012129028364919004019686867528573314565492885548699;
-        new_pos.y = 0.655614218769465062251320027664617466691295975864786403994151735;
-        double zoom = atof(argv[2]);
-        brot.changePos(new_pos, zoom);
-        brot.generate();
-        brot.updateMandelbrot();
-        brot.saveImage();
-        return 0;
-    }
-
+int main() {
     int resolution = 720;
     int iterations = 100;
-    int framerateLimit;
     float color_inc = interpolate(0, 1, 30);
+
+    //whether the image was complete when the render was stopped, so it can be
+    //started again if it wasn't
+    bool complete;
     
     //get vectors ready
-    sf::Vector2f old_position;
-    sf::Vector2f new_position;
     sf::Vector2f old_center;
     sf::Vector2f new_center;
-    sf::Vector2f difference;
-    sf::Vector2i temp;
+    sf::Vector2i old_position;
+    sf::Vector2i new_position;
 
-    //create the mandelbrotviewer instance
+    //create the mandelbrotviewer instance. The renders run in the background,
+    //every change of the view stops the last one and starts a new one
     MandelbrotViewer brot(resolution);
+    std::cout << "Using the " << kernelName(brot.getKernel()) << " kernel" << std::endl;
     brot.resetMandelbrot();
-    brot.generate();
-    brot.updateMandelbrot();
-    brot.refreshWindow();
+    brot.startRender();
 
     sf::Event event;
-    framerateLimit = brot.getFramerate();
 
     //point the zoom function to the 'brot' instance
     param.viewer = &brot;
@@ -78,7 +60,22 @@ int main(int argc, char **argv) {
     //main window loop
     while (brot.isOpen()) {
 
-        //main event loop
+        //show whatever the render has done so far. Once it's finished, print
+        //its profile and how much of it was reused or came from the cache
+        if (brot.takeFinished()) {
+            brot.printProfile();
+            const RenderStats& stats = brot.getStats();
+            if (stats.reused > 0 || stats.cached > 0) {
+                std::cout << "Reused " << 100.0 * stats.reused / (resolution * resolution)
+                          << "% of the pixels, and took "
+                          << 100.0 * stats.cached / (resolution * resolution)
+                          << "% from the cache" << std::endl;
+            }
+        }
+        brot.updateMandelbrot();
+        brot.refreshWindow();
+
+        //main event loop, it only waits for events once the render is shown
         while (brot.getEvent(event)) {
 
             //this big switch statement handles all types of input
@@ -97,33 +94,36 @@ int main(int argc, char **argv) {
                         //if up arrow, increase iterations
                         case sf::Keyboard::Up:
                             iterations += 30;
+                            brot.stopRender();
                             brot.setIterations(iterations);
-                            brot.generate();
-                            brot.updateMandelbrot();
-                            brot.refreshWindow();
+                            brot.startRender();
                             break;
                         //if down arrow, decrease iterations
                         case sf::Keyboard::Down:
                             iterations -= 30;
                             if (iterations < 100) iterations = 100;
+                            brot.stopRender();
                             brot.setIterations(iterations);
-                            brot.generate();
-                            brot.updateMandelbrot();
-                            brot.refreshWindow();
+                            brot.startRender();
                             break;
-                        //if right arrow, increase color_multiple until released
+                        //if right arrow, increase color_multiple until released.
+                        //The colors come from the escape times, so the render
+                        //is stopped while they change
                         case sf::Keyboard::Right:
                             color_inc = interpolate(0, 1, 25);
+                            complete = brot.stopRender();
                             while (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) {
                                 brot.setColorMultiple(brot.getColorMultiple() + color_inc);
                                 brot.changeColor();
                                 brot.updateMandelbrot();
                                 brot.refreshWindow();
                             }
+                            if (!complete) brot.startRender();
                             break;
                         //if left arrow, decrease color_multiple until released
                         case sf::Keyboard::Left:
                             color_inc = interpolate(1, 0, 25);
+                            complete = brot.stopRender();
                             while (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) {
                                 if (brot.getColorMultiple() > 1) {
                                     brot.setColorMultiple(brot.getColorMultiple() + color_inc);
@@ -132,39 +132,54 @@ int main(int argc, char **argv) {
                                     brot.refreshWindow();
                                 }
                             }
+                            if (!complete) brot.startRender();
                             break;
                         //if it's a 1, change to color scheme 1
                         case sf::Keyboard::Num1:
+                            complete = brot.stopRender();
                             brot.setColorScheme(1);
                             brot.changeColor();
                             brot.updateMandelbrot();
                             brot.refreshWindow();
+                            if (!complete) brot.startRender();
                             break;
                         //if it's a 2, change to color scheme 2
                         case sf::Keyboard::Num2:
+                            complete = brot.stopRender();
                             brot.setColorScheme(2);
                             brot.changeColor();
                             brot.updateMandelbrot();
                             brot.refreshWindow();
+                            if (!complete) brot.startRender();
                             break;
                         //if it's a 3, change to color scheme 3
                         case sf::Keyboard::Num3:
+                            complete = brot.stopRender();
                             brot.setColorScheme(3);
                             brot.changeColor();
                             brot.updateMandelbrot();
                             brot.refreshWindow();
+                            if (!complete) brot.startRender();
                             break;
                         //if R, reset the mandelbrot to the starting image
                         case sf::Keyboard::R:
+                            brot.stopRender();
                             brot.resetMandelbrot();
                             brot.resetView();
-                            brot.generate();
-                            brot.updateMandelbrot();
-                            brot.refreshWindow();
+                            brot.startRender();
                             break;
-                        //if S, save the current image
+                        //if S, save the current image, as far as it got
                         case sf::Keyboard::S:
+                            complete = brot.stopRender();
                             brot.saveImage();
+                            if (!complete) brot.startRender();
+                            break;
+                        //if P, turn profiling on or off
+                        case sf::Keyboard::P:
+                            complete = brot.stopRender();
+                            brot.setProfiling(!brot.getProfiling());
+                            std::cout << "Profiling is " << (brot.getProfiling() ? "on" : "off") << std::endl;
+                            if (!complete) brot.startRender();
                             break;
 		    case sf::Keyboard::M:
 	    case sf::Keyboard::N:
@@ -177,12 +192,13 @@ int main(int argc, char **argv) {
 
                     //if it's an upward scroll, get ready to zoom in
                     //if (event.mouseWheelScroll.delta > 0) {
+                    brot.stopRender();
 		    if (event.key.code == sf::Keyboard::M) {
-                        brot.changePos(brot.pixelToComplex(new_center), 0.5);
+                        brot.zoomStep(true);
                         param.zoom = 0.5;
                     } //if it's a downward scroll, get ready to zoom out
                     else {
-                        brot.changePos(brot.pixelToComplex(new_center), 2.0);
+                        brot.zoomStep(false);
                         param.zoom = 2.0;
                     }
 
@@ -190,21 +206,12 @@ int main(int argc, char **argv) {
                     param.oldc = old_center;
                     param.newc = new_center;
 
-                    //start zooming with a worker thread, so that it can generate
-                    //the new image while it's zooming
-                    sf::Thread thread(&zoom);
-                    thread.launch();
-                    
-                    //start generating while it's zooming
-                    brot.generate();
-
-                    //wait for the thread to finish (wait for the zoom to finish)
-                    thread.wait();
-
-                    //now display the new mandelbrot
-                    brot.updateMandelbrot();
+                    //the new image generates in the background while the old
+                    //one zooms. The zoom step already moved the image onto the
+                    //new view, so it isn't shown until the zoom is done
+                    brot.startRender();
+                    zoom();
                     brot.resetView();
-                    brot.refreshWindow();
                     break; 
                 }
                         //end the keypress switch
@@ -264,72 +271,28 @@ int main(int argc, char **argv) {
                 //if the event is a click, drag the view:
                 case sf::Event::MouseButtonPressed:
 
-                    //set drag frames low so that it will move in real time
-                    param.frames = 2;
-
-                    //save the old center/mouse_position as reference
-                    temp = brot.getMousePosition();
-                    old_position.x = temp.x;
-                    old_position.y = temp.y;
-                    old_center = brot.getViewCenter();
-                    param.oldc.x = old_center.x;
-                    param.oldc.y = old_center.y;
-
-                    //set zoom to 1 so that it doesn't change, only drags
-                    param.zoom = 1.0;
-
-                    //set the framrate very high so that it will drag in real time
-                    brot.setFramerate(500);
+                    //save the mouse position as reference
+                    old_position = brot.getMousePosition();
 
                     while (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
 
-                        //get the new mouse position
-                        temp = brot.getMousePosition();
-                        new_position.x = temp.x;
-                        new_position.y = temp.y;
-
-                        //get the difference between the old and new positions
-                        difference.x = new_position.x - old_position.x;
-                        difference.y = new_position.y - old_position.y;
-
-                        //calculate the new center
-                        new_center = old_center - difference;
-                        param.newc.x = new_center.x;
-                        param.newc.y = new_center.y;
-
-                        //run the zoom function, but since param.zoom is set to 1,
-                        //it will only drag
-                        zoom();
-
-                        //start over again until the mouse is released
-                        param.oldc = param.newc;
+                        //move the view the other way by whole pixels every
+                        //time the mouse moves, so that only the part of the
+                        //image that was uncovered is generated. The render of
+                        //the last position is cancelled, but what it finished
+                        //is kept
+                        new_position = brot.getMousePosition();
+                        if (new_position != old_position) {
+                            brot.stopRender();
+                            brot.panPixels(old_position.x - new_position.x, old_position.y - new_position.y);
+                            brot.startRender();
+                            old_position = new_position;
+                        }
+
+                        //show the render while it's dragging
+                        brot.updateMandelbrot();
+                        brot.refreshWindow();
                     }
-
-                    //set the framerate back to default
-                    brot.setFramerate(framerateLimit);
-
-                    //now regenerate the mandelbrot at the new position.
-                    //This can't be threaded like zoom, because it doesn't
-                    //know where to generate at until it's done dragging
-                    temp = brot.getMousePosition();
-                    new_position.x = temp.x;
-                    new_position.y = temp.y;
-
-                    //get the difference of how far it's moved
-                    difference.x = new_position.x - old_position.x;
-                    difference.y = new_position.y - old_position.y;
-
-                    //set the old center
-                    old_center = sf::Vector2f(resolution/2, resolution/2);
-
-                    //calculate the new center
-                    new_center = old_center - difference;
-
-                    brot.changePos(brot.pixelToComplex(new_center), 1.0);
-                    brot.generate();
-                    brot.resetView();
-                    brot.updateMandelbrot();
-                    brot.refreshWindow();
                     break;
                 
                 default:
@@ -0,0 +1,716 @@
+#include "mandelbrotFarm.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+//every message is its type and the size of the rest, then the rest. A worker
+//says hello with its version and threads, then keeps saying it's alive while
+//it works. The coordinator sends the view once per render, then tiles as the
+//worker has room for them, and the worker sends back a result for each one
+enum MessageType {
+    MESSAGE_HELLO = 1,
+    MESSAGE_ALIVE = 2,
+    MESSAGE_VIEW = 3,
+    MESSAGE_TILES = 4,
+    MESSAGE_RESULT = 5
+};
+static const uint32_t farm_version = 1;
+static const uint32_t max_message = 1 << 28;
+static const size_t header_size = 8;
+
+//how the escape times of a result are packed
+enum {ENCODING_RAW = 0, ENCODING_ZLIB = 1};
+
+//how often a worker says it's alive, in seconds
+static const double alive_interval = 1.0;
+
+//the seconds since some fixed time
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//the body of a message, which is read back in the order it was written
+struct Message {
+    std::vector<uint8_t> data;
+    size_t position;
+
+    Message() {position = 0;}
+
+    void put(const void *value, size_t size) {
+        const uint8_t *bytes = (const uint8_t *) value;
+        data.insert(data.end(), bytes, bytes + size);
+    }
+    template <typename T> void put(T value) {put(&value, sizeof(T));}
+    void putString(const std::string& text) {
+        put((uint32_t) text.size());
+        put(text.data(), text.size());
+    }
+
+    bool get(void *value, size_t size) {
+        if (data.size() - position < size) return false;
+        if (size > 0) memcpy(value, &data[position], size);
+        position += size;
+        return true;
+    }
+    template <typename T> bool get(T& value) {return get(&value, sizeof(T));}
+    bool getString(std::string& text) {
+        uint32_t size;
+        if (!get(size) || data.size() - position < size) return false;
+        text.assign((const char *) &data[position], size);
+        position += size;
+        return true;
+    }
+};
+
+//adds the message, with its header, to the end of out
+static void frame(uint32_t type, const Message& message, std::vector<uint8_t>& out) {
+    uint32_t header[2] = {type, (uint32_t) message.data.size()};
+    const uint8_t *bytes = (const uint8_t *) header;
+    out.insert(out.end(), bytes, bytes + header_size);
+    out.insert(out.end(), message.data.begin(), message.data.end());
+}
+
+//the high precision numbers are sent as decimals with a digit for every bit,
+//which is enough for them to be read back exactly
+static void putNumber(Message& message, const HighPrecision& value) {
+    message.put((uint32_t) value.getLimbs());
+    message.putString(value.toString(32 * value.getLimbs()));
+}
+
+static bool getNumber(Message& message, HighPrecision& value) {
+    uint32_t limbs;
+    std::string text;
+    return message.get(limbs) && limbs >= 1 && limbs <= (uint32_t) HighPrecision::max_limbs &&
+           message.getString(text) && HighPrecision::parse(text, (int) limbs, value);
+}
+
+static void putView(Message& message, const TileView& view, bool zlib) {
+    message.put((uint8_t) zlib);
+    message.put((int32_t) view.width);
+    message.put((int32_t) view.height);
+    message.put((int32_t) view.tile_size);
+    message.put((int32_t) view.tile_offset_x);
+    message.put((int32_t) view.tile_offset_y);
+    message.put(view.area_width);
+    message.put(view.area_height);
+    putNumber(message, view.origin_x);
+    putNumber(message, view.origin_y);
+    message.put((int32_t) view.shift_x);
+    message.put((int32_t) view.shift_y);
+    message.put(view.grid_left);
+    message.put(view.grid_top);
+    message.put(view.origin_column);
+    message.put(view.origin_row);
+    message.put((int32_t) view.max_iter);
+    message.put((int32_t) view.tier);
+    message.put((uint8_t) view.subdivision);
+    message.put((uint8_t) view.series);
+}
+
+static bool getView(Message& message, TileView& view, bool& zlib) {
+    uint8_t flags[3];
+    int32_t ints[11];
+    bool ok = message.get(flags[0]) && message.get(ints[0]) && message.get(ints[1]) &&
+              message.get(ints[2]) && message.get(ints[3]) && message.get(ints[4]) &&
+              message.get(view.area_width) && message.get(view.area_height) &&
+              getNumber(message, view.origin_x) && getNumber(message, view.origin_y) &&
+              message.get(ints[5]) && message.get(ints[6]) && message.get(view.grid_left) &&
+              message.get(view.grid_top) && message.get(view.origin_column) &&
+              message.get(view.origin_row) && message.get(ints[7]) && message.get(ints[8]) &&
+              message.get(flags[1]) && message.get(flags[2]);
+    if (!ok) return false;
+    zlib = flags[0] != 0;
+    view.width = ints[0];
+    view.height = ints[1];
+    view.tile_size = ints[2];
+    view.tile_offset_x = ints[3];
+    view.tile_offset_y = ints[4];
+    view.shift_x = ints[5];
+    view.shift_y = ints[6];
+    view.max_iter = ints[7];
+    view.tier = (PrecisionTier) ints[8];
+    view.subdivision = flags[1] != 0;
+    view.series = flags[2] != 0;
+    return view.width > 0 && view.height > 0 && view.tile_size > 0 && view.max_iter > 0 &&
+           view.tier >= 0 && view.tier < PRECISION_AUTO && precisionSupported(view.tier);
+}
+
+//the escape times of a tile are sent as the difference from the pixel before,
+//which is 0 across the large areas of one escape time and small near the
+//boundary, so it compresses well
+static void encodeTile(const int *iters, int count, bool zlib, Message& message) {
+    std::vector<int32_t> deltas(count);
+    int32_t last = 0;
+    for (int i = 0; i < count; i++) {
+        deltas[i] = iters[i] - last;
+        last = iters[i];
+    }
+    uint32_t encoding = ENCODING_RAW;
+    const uint8_t *data = (const uint8_t *) &deltas[0];
+    size_t size = (size_t) count * sizeof(int32_t);
+#ifdef USE_ZLIB
+    std::vector<uint8_t> packed;
+    if (zlib) {
+        uLongf packed_size = compressBound((uLong) size);
+        packed.resize(packed_size);
+        if (compress2(&packed[0], &packed_size, data, (uLong) size, Z_BEST_SPEED) == Z_OK) {
+            encoding = ENCODING_ZLIB;
+            data = &packed[0];
+            size = packed_size;
+        }
+    }
+#else
+    (void) zlib;
+#endif
+    message.put(encoding);
+    message.put((uint32_t) size);
+    message.put(data, size);
+}
+
+//unpacks count escape times, and returns the size they were sent in as bytes
+static bool decodeTile(Message& message, int count, std::vector<int>& iters, long long& bytes) {
+    uint32_t encoding, size;
+    if (!message.get(encoding) || !message.get(size) || message.data.size() - message.position < size) {
+        return false;
+    }
+    const uint8_t *data = &message.data[0] + message.position;
+    size_t raw = (size_t) count * sizeof(int32_t);
+    iters.resize(count);
+    if (encoding == ENCODING_RAW) {
+        if (size != raw) return false;
+        memcpy(&iters[0], data, raw);
+#ifdef USE_ZLIB
+    } else if (encoding == ENCODING_ZLIB) {
+        uLongf unpacked = (uLongf) raw;
+        if (uncompress((Bytef *) &iters[0], &unpacked, data, size) != Z_OK || unpacked != raw) return false;
+#endif
+    } else {
+        return false;
+    }
+    int last = 0;
+    for (int i = 0; i < count; i++) {
+        iters[i] += last;
+        last = iters[i];
+    }
+    bytes = size;
+    return true;
+}
+
+//opens a socket for the address, bound and listening or connected to it. A
+//unix socket left behind by a coordinator that didn't exit cleanly is replaced
+static int openSocket(const std::string& address, bool listening, std::string& error) {
+    int sock = -1;
+    if (address.compare(0, 5, "unix:") == 0) {
+        std::string path = address.substr(5);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            error = "the socket path is empty or too long";
+            return -1;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            error = strerror(errno);
+            return -1;
+        }
+        struct stat info;
+        if (listening && stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path.c_str());
+        bool ok = listening ? bind(sock, (sockaddr *) &addr, sizeof(addr)) == 0 && ::listen(sock, 64) == 0 :
+                              connect(sock, (sockaddr *) &addr, sizeof(addr)) == 0;
+        if (!ok) {
+            error = strerror(errno);
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        error = "addresses are unix:<path> or <host>:<port>";
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo *found = NULL;
+    int result = getaddrinfo(host.empty() ? (listening ? NULL : "localhost") : host.c_str(),
+                             port.c_str(), &hints, &found);
+    if (result != 0) {
+        error = gai_strerror(result);
+        return -1;
+    }
+    error = "no usable address";
+    for (addrinfo *info = found; info != NULL; info = info->ai_next) {
+        sock = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+        if (sock < 0) continue;
+        int one = 1;
+        bool ok;
+        if (listening) {
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(sock, info->ai_addr, info->ai_addrlen) == 0 && ::listen(sock, 64) == 0;
+        } else {
+            ok = connect(sock, info->ai_addr, info->ai_addrlen) == 0;
+            if (ok) setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (ok) break;
+        error = strerror(errno);
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(found);
+    return sock;
+}
+
+//the worker's end is blocking, so these don't return until all of it is
+//through or the connection is gone
+static bool readFully(int sock, void *buffer, size_t size) {
+    uint8_t *bytes = (uint8_t *) buffer;
+    while (size > 0) {
+        ssize_t done = recv(sock, bytes, size, 0);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        bytes += done;
+        size -= done;
+    }
+    return true;
+}
+
+static bool writeFully(int sock, const std::vector<uint8_t>& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t done = send(sock, &data[sent], data.size() - sent, MSG_NOSIGNAL);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        sent += done;
+    }
+    return true;
+}
+
+static bool sendMessage(int sock, uint32_t type, const Message& message) {
+    std::vector<uint8_t> data;
+    frame(type, message, data);
+    return writeFully(sock, data);
+}
+
+//Constructor
+FarmCoordinator::FarmCoordinator() {
+    listener = -1;
+    view_id = 0;
+    job = NULL;
+    slow_timeout = 5.0;
+    dead = 10.0;
+    stats = FarmStats();
+}
+
+FarmCoordinator::~FarmCoordinator() {
+    for (size_t i = 0; i < connections.size(); i++) {
+        if (!connections[i].closed) close(connections[i].socket);
+    }
+    if (listener >= 0) close(listener);
+    if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+bool FarmCoordinator::listen(const std::string& address, std::string& error) {
+    listener = openSocket(address, true, error);
+    if (listener < 0) return false;
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    if (address.compare(0, 5, "unix:") == 0) unix_path = address.substr(5);
+    return true;
+}
+
+int FarmCoordinator::waitForWorkers(int count, double seconds) {
+    double start = now();
+    while (getWorkers() < count && now() - start < seconds) poll(50);
+    return getWorkers();
+}
+
+int FarmCoordinator::getWorkers() {
+    int count = 0;
+    for (size_t i = 0; i < connections.size(); i++) {
+        if (connections[i].ready && !connections[i].closed) count++;
+    }
+    return count;
+}
+
+//deals out the tiles until they are all back, or there are no workers left to
+//do the rest
+void FarmCoordinator::render(const TileView& view, std::vector<Tile>& tiles, const TileDone& done) {
+    if (listener < 0 || tiles.empty()) return;
+    view_id++;
+    Message message;
+    message.put(view_id);
+#ifdef USE_ZLIB
+    putView(message, view, true);
+#else
+    putView(message, view, false);
+#endif
+    view_message.clear();
+    frame(MESSAGE_VIEW, message, view_message);
+
+    Job current;
+    current.tiles = &tiles;
+    current.done = &done;
+    current.finished.assign(tiles.size(), 0);
+    current.holders.assign(tiles.size(), 0);
+    current.sent.assign(tiles.size(), 0.0);
+    for (size_t i = 0; i < tiles.size(); i++) current.waiting.push_back((int) i);
+    current.left = (int) tiles.size();
+    job = &current;
+
+    acceptWorkers();
+    while (current.left > 0 && !connections.empty()) {
+        double time = now();
+        for (size_t i = 0; i < connections.size(); i++) dealTiles(connections[i], time);
+        poll(20);
+    }
+    job = NULL;
+
+    //the tiles still out with the workers come back with an old view, and
+    //are thrown away
+    for (size_t i = 0; i < connections.size(); i++) connections[i].tiles.clear();
+    std::vector<Tile> rest;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (!current.finished[i]) rest.push_back(tiles[i]);
+    }
+    tiles.swap(rest);
+}
+
+void FarmCoordinator::acceptWorkers() {
+    while (true) {
+        int sock = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) return;
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection connection;
+        connection.socket = sock;
+        connection.ready = false;
+        connection.threads = 1;
+        connection.view = 0;
+        connection.heard = now();
+        connection.closed = false;
+        connections.push_back(connection);
+    }
+}
+
+//a worker with nothing to do gets twice as many tiles as it has threads, and
+//more whenever it's down to one per thread, so it never runs out while it
+//waits for the next ones
+void FarmCoordinator::dealTiles(Connection& connection, double time) {
+    if (!connection.ready || connection.closed || job == NULL) return;
+    if ((int) connection.tiles.size() > connection.threads) return;
+    std::vector<int> given;
+    int room = 2 * connection.threads - (int) connection.tiles.size();
+    while (room > 0 && !job->waiting.empty()) {
+        int index = job->waiting.front();
+        job->waiting.pop_front();
+        if (job->finished[index]) continue;
+        given.push_back(index);
+        room--;
+    }
+
+    //once every tile has been handed out, a worker with room takes the one
+    //that has been out the longest, if it's been out too long
+    if (given.empty() && (int) connection.tiles.size() < connection.threads) {
+        int oldest = -1;
+        for (size_t i = 0; i < job->finished.size(); i++) {
+            if (job->finished[i] || job->holders[i] == 0 || time - job->sent[i] < slow_timeout) continue;
+            if (std::find(connection.tiles.begin(), connection.tiles.end(), (int) i) != connection.tiles.end()) {
+                continue;
+            }
+            if (oldest < 0 || job->sent[i] < job->sent[oldest]) oldest = (int) i;
+        }
+        if (oldest >= 0) {
+            given.push_back(oldest);
+            stats.duplicated++;
+        }
+    }
+    if (given.empty()) return;
+
+    //it's been quiet while it had nothing to do, so it starts counting now
+    if (connection.tiles.empty()) connection.heard = time;
+    if (connection.view != view_id) {
+        connection.out.insert(connection.out.end(), view_message.begin(), view_message.end());
+        connection.view = view_id;
+    }
+    Message message;
+    message.put(view_id);
+    message.put((uint32_t) given.size());
+    for (size_t i = 0; i < given.size(); i++) {
+        const Tile& tile = (*job->tiles)[given[i]];
+        message.put((int32_t) tile.x);
+        message.put((int32_t) tile.y);
+        message.put((int32_t) tile.width);
+        message.put((int32_t) tile.height);
+        job->holders[given[i]]++;
+        job->sent[given[i]] = time;
+        connection.tiles.push_back(given[i]);
+    }
+    frame(MESSAGE_TILES, message, connection.out);
+}
+
+void FarmCoordinator::poll(int milliseconds) {
+    std::vector<pollfd> sockets(connections.size() + 1);
+    sockets[0].fd = listener;
+    sockets[0].events = POLLIN;
+    for (size_t i = 0; i < connections.size(); i++) {
+        sockets[i + 1].fd = connections[i].socket;
+        sockets[i + 1].events = POLLIN | (connections[i].out.empty() ? 0 : POLLOUT);
+    }
+    if (::poll(&sockets[0], sockets.size(), milliseconds) < 0) return;
+
+    //the new workers are added after the ones that were polled
+    size_t count = connections.size();
+    if (sockets[0].revents & POLLIN) acceptWorkers();
+    for (size_t i = 0; i < count; i++) {
+        Connection& connection = connections[i];
+        short events = sockets[i + 1].revents;
+        if ((events & POLLOUT) && !connection.out.empty()) {
+            ssize_t done = send(connection.socket, &connection.out[0], connection.out.size(), MSG_NOSIGNAL);
+            if (done < 0 && errno != EAGAIN && errno != EINTR) {
+                drop(connection);
+                continue;
+            }
+            if (done > 0) connection.out.erase(connection.out.begin(), connection.out.begin() + done);
+        }
+        if (!(events & (POLLIN | POLLHUP | POLLERR))) continue;
+        uint8_t buffer[65536];
+        while (!connection.closed) {
+            ssize_t done = recv(connection.socket, buffer, sizeof(buffer), 0);
+            if (done < 0 && (errno == EAGAIN || errno == EINTR)) break;
+            if (done <= 0) {
+                drop(connection);
+                break;
+            }
+            connection.in.insert(connection.in.end(), buffer, buffer + done);
+        }
+        if (!connection.closed) readMessages(connection);
+    }
+
+    //a worker that went quiet while it had tiles, or never said hello, is
+    //taken to be gone
+    double time = now();
+    for (size_t i = 0; i < connections.size(); i++) {
+        Connection& connection = connections[i];
+        if (connection.closed || (connection.ready && connection.tiles.empty())) continue;
+        if (time - connection.heard > dead) drop(connection);
+    }
+    connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                     [] (const Connection& c) {return c.closed;}), connections.end());
+}
+
+void FarmCoordinator::readMessages(Connection& connection) {
+    size_t start = 0;
+    std::vector<int> iters;
+    while (connection.in.size() - start >= header_size) {
+        uint32_t header[2];
+        memcpy(header, &connection.in[start], header_size);
+        if (header[1] > max_message) {
+            drop(connection);
+            return;
+        }
+        if (connection.in.size() - start - header_size < header[1]) break;
+        Message message;
+        message.data.assign(connection.in.begin() + start + header_size,
+                            connection.in.begin() + start + header_size + header[1]);
+        start += header_size + header[1];
+        connection.heard = now();
+
+        bool ok = true;
+        if (header[0] == MESSAGE_HELLO) {
+            uint32_t version;
+            int32_t threads;
+            ok = !connection.ready && message.get(version) && message.get(threads) && version == farm_version;
+            if (ok) {
+                connection.ready = true;
+                connection.threads = std::max(threads, 1);
+                stats.joined++;
+            }
+        } else if (header[0] == MESSAGE_RESULT) {
+            uint32_t id;
+            int32_t box[4];
+            ok = connection.ready && message.get(id) && message.get(box[0]) && message.get(box[1]) &&
+                 message.get(box[2]) && message.get(box[3]);
+            if (!ok) {
+                drop(connection);
+                return;
+            }
+            if (job == NULL || id != view_id) continue;
+
+            //only the tiles it was given are taken, and only the first time
+            //one comes back
+            std::vector<int>& held = connection.tiles;
+            std::vector<int>::iterator found = std::find_if(held.begin(), held.end(), [this, box] (int index) {
+                const Tile& tile = (*job->tiles)[index];
+                return tile.x == box[0] && tile.y == box[1] && tile.width == box[2] && tile.height == box[3];
+            });
+            if (found == held.end()) continue;
+            int index = *found;
+            held.erase(found);
+            job->holders[index]--;
+            long long bytes;
+            if (!decodeTile(message, box[2] * box[3], iters, bytes)) {
+                drop(connection);
+                return;
+            }
+            if (job->finished[index]) continue;
+            job->finished[index] = 1;
+            job->left--;
+            stats.tiles++;
+            stats.bytes += bytes;
+            stats.raw_bytes += (long long) box[2] * box[3] * sizeof(int32_t);
+            (*job->done)((*job->tiles)[index], &iters[0]);
+        } else {
+            ok = header[0] == MESSAGE_ALIVE;
+        }
+        if (!ok) {
+            drop(connection);
+            return;
+        }
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + start);
+}
+
+void FarmCoordinator::drop(Connection& connection) {
+    if (connection.closed) return;
+    close(connection.socket);
+    connection.closed = true;
+    if (connection.ready) stats.left++;
+    for (size_t i = 0; job != NULL && i < connection.tiles.size(); i++) {
+        int index = connection.tiles[i];
+        job->holders[index]--;
+        if (!job->finished[index] && job->holders[index] == 0) {
+            job->waiting.push_front(index);
+            stats.reassigned++;
+        }
+    }
+    connection.tiles.clear();
+}
+
+//the worker works on one batch of tiles at a time, while another thread keeps
+//telling the coordinator it's alive. The two share the socket, one message at
+//a time
+bool runFarmWorker(const std::string& address, int threads, double delay, std::ostream& log) {
+    std::string error;
+    int sock = openSocket(address, false, error);
+    if (sock < 0) {
+        log << "Can't connect to " << address << ": " << error << std::endl;
+        return false;
+    }
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4;
+    }
+    std::mutex sending;
+    Message hello;
+    hello.put(farm_version);
+    hello.put((int32_t) threads);
+    if (!sendMessage(sock, MESSAGE_HELLO, hello)) {
+        log << "Lost the connection to " << address << std::endl;
+        close(sock);
+        return false;
+    }
+    log << "Joined " << address << " with " << threads << " threads" << std::endl;
+
+    bool stopping = false;
+    std::condition_variable stop;
+    std::thread alive([&] () {
+        std::unique_lock<std::mutex> lock(sending);
+        while (!stop.wait_for(lock, std::chrono::duration<double>(alive_interval), [&] {return stopping;})) {
+            sendMessage(sock, MESSAGE_ALIVE, Message());
+        }
+    });
+
+    MandelbrotEngine *engine = NULL;
+    uint32_t current = 0;
+    bool zlib = false;
+    bool ok = true;
+    long long generated = 0;
+    while (ok) {
+        uint32_t header[2];
+        if (!readFully(sock, header, header_size)) break;
+        Message message;
+        ok = header[1] <= max_message;
+        if (ok) {
+            message.data.resize(header[1]);
+            ok = readFully(sock, message.data.empty() ? NULL : &message.data[0], header[1]);
+        }
+        if (ok && header[0] == MESSAGE_VIEW) {
+            TileView view;
+            ok = message.get(current) && getView(message, view, zlib);
+            if (!ok) break;
+            if (engine == NULL || engine->getWidth() != view.width || engine->getHeight() != view.height) {
+                delete engine;
+                engine = new MandelbrotEngine(view.width, view.height, threads);
+            }
+            engine->setTileView(view);
+            log << "View " << current << ": " << view.width << "x" << view.height << ", max_iter "
+                << view.max_iter << ", " << precisionName(view.tier) << " precision" << std::endl;
+        } else if (ok && header[0] == MESSAGE_TILES) {
+            uint32_t id, count;
+            ok = message.get(id) && message.get(count) && id == current && engine != NULL;
+            std::vector<Tile> tiles(ok ? count : 0);
+            for (size_t i = 0; ok && i < tiles.size(); i++) {
+                int32_t box[4];
+                ok = message.get(box[0]) && message.get(box[1]) && message.get(box[2]) && message.get(box[3]) &&
+                     box[0] >= 0 && box[1] >= 0 && box[2] > 0 && box[3] > 0 &&
+                     box[0] + box[2] <= engine->getWidth() && box[1] + box[3] <= engine->getHeight();
+                if (!ok) break;
+                tiles[i].x = box[0];
+                tiles[i].y = box[1];
+                tiles[i].width = box[2];
+                tiles[i].height = box[3];
+            }
+            if (!ok) break;
+            if (delay > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(delay * tiles.size()));
+            engine->generateTiles(tiles, [&] (const Tile& tile, const int *iters) {
+                Message result;
+                result.put(current);
+                result.put((int32_t) tile.x);
+                result.put((int32_t) tile.y);
+                result.put((int32_t) tile.width);
+                result.put((int32_t) tile.height);
+                encodeTile(iters, tile.width * tile.height, zlib, result);
+                std::lock_guard<std::mutex> lock(sending);
+                if (ok) ok = sendMessage(sock, MESSAGE_RESULT, result);
+            });
+            generated += tiles.size();
+        } else if (ok) {
+            ok = false;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sending);
+        stopping = true;
+    }
+    stop.notify_all();
+    alive.join();
+    close(sock);
+    delete engine;
+
+    if (!ok) log << "Lost the connection to " << address << ", or it sent something wrong" << std::endl;
+    else log << "The coordinator closed the connection" << std::endl;
+    log << "Generated " << generated << " tiles" << std::endl;
+    return ok;
+}
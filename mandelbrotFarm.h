@@ -0,0 +1,128 @@
+#ifndef MANDELBROTFARM_H
+#define MANDELBROTFARM_H
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mandelbrotEngine.h"
+
+//The tile farm splits renders up between worker processes, on this machine or
+//others. The coordinator listens on an address, which is unix:<path> for a
+//unix socket or <host>:<port> for TCP (the host can be left out to listen on
+//every interface), and the workers connect to it whenever they like. Each
+//render the coordinator sends the view to the workers and deals them the tiles
+//a few at a time, and they send back each tile's escape times, compressed.
+//Everything is sent in the byte order of the machine, so the coordinator and
+//the workers have to agree on it
+
+//what the farm has done since it started. reassigned counts the tiles that
+//were handed out again after their worker left, duplicated the ones handed to
+//a second worker because the first was too slow
+struct FarmStats {
+    int joined;
+    int left;
+    long long tiles;
+    long long reassigned;
+    long long duplicated;
+    long long bytes;
+    long long raw_bytes;
+};
+
+//FarmCoordinator is the TileFarm the engine uses, it runs each render on the
+//thread that called it. Workers that join while it's waiting between renders
+//get their first tiles at the next one
+class FarmCoordinator : public TileFarm {
+    public:
+        FarmCoordinator();
+        ~FarmCoordinator();
+
+        //it owns the sockets, so it can't be copied
+        FarmCoordinator(const FarmCoordinator&) = delete;
+        FarmCoordinator& operator=(const FarmCoordinator&) = delete;
+
+        //starts listening on the address, returns false and says why in error
+        //if it can't
+        bool listen(const std::string& address, std::string& error);
+
+        //waits until count workers have joined, for up to the given number of
+        //seconds. Returns the number there are
+        int waitForWorkers(int count, double seconds);
+
+        //a tile that has been out for timeout seconds is handed to another
+        //worker as well, once there are no new ones left to hand out. A worker
+        //that hasn't sent anything for dead_timeout seconds is dropped, and
+        //its tiles go to the others
+        void setTimeouts(double timeout, double dead_timeout) {slow_timeout = timeout; dead = dead_timeout;}
+
+        //Accesor functions:
+        int getWorkers();
+        const FarmStats& getStats() {return stats;}
+
+        void render(const TileView& view, std::vector<Tile>& tiles, const TileDone& done);
+
+    private:
+        //a connection to a worker. in has what was read that isn't a whole
+        //message yet, out what is waiting to be written. tiles are the tiles
+        //of the render it was given and hasn't sent back
+        struct Connection {
+            int socket;
+            bool ready;
+            int threads;
+            uint32_t view;
+            std::vector<uint8_t> in;
+            std::vector<uint8_t> out;
+            std::vector<int> tiles;
+            double heard;
+            bool closed;
+        };
+
+        //the render that is going on. Each tile is either waiting to be
+        //handed out, or held by one or more workers until it's finished
+        struct Job {
+            const std::vector<Tile> *tiles;
+            const TileDone *done;
+            std::vector<char> finished;
+            std::vector<int> holders;
+            std::vector<double> sent;
+            std::deque<int> waiting;
+            int left;
+        };
+
+        int listener;
+        std::string unix_path;
+        std::vector<Connection> connections;
+        uint32_t view_id;
+        std::vector<uint8_t> view_message;
+        Job *job;
+        double slow_timeout;
+        double dead;
+        FarmStats stats;
+
+        //accepts the workers that are waiting to join
+        void acceptWorkers();
+
+        //waits up to milliseconds for the sockets, then reads and writes what
+        //they are ready for
+        void poll(int milliseconds);
+
+        //handles the messages that have come in, and drops the connection if
+        //one of them doesn't make sense
+        void readMessages(Connection& connection);
+
+        //hands the worker more tiles if it has room for them
+        void dealTiles(Connection& connection, double now);
+
+        //closes the connection, and puts the tiles no other worker has back
+        //to be handed out first
+        void drop(Connection& connection);
+};
+
+//connects to the coordinator at the address and generates the tiles it hands
+//out with an engine of the given number of threads, until the coordinator goes
+//away. delay is slept before each tile, to try out a slow worker. Returns false
+//if it couldn't connect or something went wrong, and says what in log
+bool runFarmWorker(const std::string& address, int threads, double delay, std::ostream& log);
+
+#endif
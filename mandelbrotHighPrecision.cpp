@@ -0,0 +1,216 @@
+#include "mandelbrotHighPrecision.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+//Constructor: zero
+HighPrecision::HighPrecision(int limbs) {
+    this->limbs = (limbs < 2) ? 2 : (limbs > max_limbs ? max_limbs : limbs);
+    for (int i = 0; i < max_limbs; i++) {
+        limb[i] = 0;
+    }
+}
+
+//Constructor: a double is a 53 bit fraction, so it is converted exactly by
+//peeling off 32 bits at a time
+HighPrecision::HighPrecision(double value, int limbs) {
+    *this = HighPrecision(limbs);
+    double rest = std::fabs(value);
+    for (int i = 0; i < this->limbs && rest != 0.0; i++) {
+        double whole = std::floor(rest);
+        limb[i] = (uint32_t) whole;
+        rest = (rest - whole) * 4294967296.0;
+    }
+    if (value < 0.0) *this = -*this;
+}
+
+//reads the integer part as a number, and the fraction by repeatedly multiplying
+//its decimal digits by 2^32 and taking what carries out as the next limb
+bool HighPrecision::parse(const std::string& text, int limbs, HighPrecision& value) {
+    if (text.find_first_of("eE") != std::string::npos) {
+        char *end;
+        double number = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || *end != '\0') return false;
+        value = HighPrecision(number, limbs);
+        return true;
+    }
+
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
+    }
+
+    HighPrecision result(limbs);
+    uint64_t whole = 0;
+    bool digits = false;
+    while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+        whole = whole * 10 + (text[pos] - '0');
+        if (whole > 0x7fffffff) return false;
+        digits = true;
+        pos++;
+    }
+    result.limb[0] = (uint32_t) whole;
+
+    std::vector<int> fraction;
+    if (pos < text.size() && text[pos] == '.') {
+        pos++;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            fraction.push_back(text[pos] - '0');
+            digits = true;
+            pos++;
+        }
+    }
+    if (!digits || pos != text.size()) return false;
+
+    for (int i = 1; i < result.limbs; i++) {
+        uint64_t carry = 0;
+        for (int j = (int) fraction.size() - 1; j >= 0; j--) {
+            uint64_t product = ((uint64_t) fraction[j] << 32) + carry;
+            fraction[j] = (int) (product % 10);
+            carry = product / 10;
+        }
+        result.limb[i] = (uint32_t) carry;
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+//adds up the limbs from the least significant one, so only the last addition
+//rounds
+double HighPrecision::toDouble() const {
+    HighPrecision abs = magnitude();
+    double value = 0.0;
+    for (int i = limbs - 1; i >= 0; i--) {
+        value += std::ldexp((double) abs.limb[i], -32 * i);
+    }
+    return isNegative() ? -value : value;
+}
+
+//the opposite of parse: the fraction digits come from repeatedly multiplying the
+//fraction limbs by 10
+std::string HighPrecision::toString(int digits) const {
+    HighPrecision abs = magnitude();
+    std::string text = isNegative() ? "-" : "";
+    text += std::to_string(abs.limb[0]);
+    if (digits <= 0) return text;
+
+    text += '.';
+    for (int d = 0; d < digits; d++) {
+        uint64_t carry = 0;
+        for (int i = limbs - 1; i >= 1; i--) {
+            uint64_t product = (uint64_t) abs.limb[i] * 10 + carry;
+            abs.limb[i] = (uint32_t) product;
+            carry = product >> 32;
+        }
+        text += (char) ('0' + carry);
+    }
+    return text;
+}
+
+HighPrecision HighPrecision::withLimbs(int limbs) const {
+    HighPrecision result(limbs);
+    for (int i = 0; i < result.limbs && i < this->limbs; i++) {
+        result.limb[i] = limb[i];
+    }
+    return result;
+}
+
+//two's complement addition, from the least significant limb up
+HighPrecision HighPrecision::operator+(const HighPrecision& other) const {
+    HighPrecision result(limbs > other.limbs ? limbs : other.limbs);
+    uint64_t carry = 0;
+    for (int i = result.limbs - 1; i >= 0; i--) {
+        uint64_t sum = (uint64_t) limb[i] + other.limb[i] + carry;
+        result.limb[i] = (uint32_t) sum;
+        carry = sum >> 32;
+    }
+    return result;
+}
+
+HighPrecision HighPrecision::operator-(const HighPrecision& other) const {
+    return *this + -other;
+}
+
+//invert and add one
+HighPrecision HighPrecision::operator-() const {
+    HighPrecision result(limbs);
+    uint64_t carry = 1;
+    for (int i = limbs - 1; i >= 0; i--) {
+        uint64_t sum = (uint64_t) (uint32_t) ~limb[i] + carry;
+        result.limb[i] = (uint32_t) sum;
+        carry = sum >> 32;
+    }
+    return result;
+}
+
+//Schoolbook multiplication of the magnitudes. With the binary point after the
+//first limb, limb k of the product is column k+1 of the full product; the
+//columns past the precision are only used for their carries, so the result is
+//truncated toward zero
+HighPrecision HighPrecision::operator*(const HighPrecision& other) const {
+    int n = limbs > other.limbs ? limbs : other.limbs;
+    HighPrecision a = magnitude().withLimbs(n);
+    HighPrecision b = other.magnitude().withLimbs(n);
+
+    uint32_t columns[2 * max_limbs] = {0};
+    for (int i = n - 1; i >= 0; i--) {
+        if (a.limb[i] == 0) continue;
+        uint64_t carry = 0;
+        for (int j = n - 1; j >= 0; j--) {
+            uint64_t product = (uint64_t) a.limb[i] * b.limb[j] + columns[i + j + 1] + carry;
+            columns[i + j + 1] = (uint32_t) product;
+            carry = product >> 32;
+        }
+        columns[i] = (uint32_t) carry;
+    }
+
+    HighPrecision result(n);
+    for (int k = 0; k < n; k++) {
+        result.limb[k] = columns[k + 1];
+    }
+    return (isNegative() != other.isNegative()) ? -result : result;
+}
+
+HighPrecision& HighPrecision::operator+=(double value) {
+    *this = *this + HighPrecision(value, limbs);
+    return *this;
+}
+
+//the missing limbs of the shorter number are zeros
+bool HighPrecision::operator==(const HighPrecision& other) const {
+    int n = limbs > other.limbs ? limbs : other.limbs;
+    for (int i = 0; i < n; i++) {
+        if (limb[i] != other.limb[i]) return false;
+    }
+    return true;
+}
+
+//FNV-1a over the limbs, leaving out the zeros at the end
+uint64_t HighPrecision::hash() const {
+    int n = limbs;
+    while (n > 1 && limb[n-1] == 0) n--;
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < n; i++) {
+        for (int b = 0; b < 32; b += 8) {
+            h ^= (limb[i] >> b) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+//the spacing needs -log2(spacing) fraction bits to be resolved at all, and the
+//reference orbit loses a few more to rounding as it goes, so 64 guard bits are
+//kept on top
+int HighPrecision::limbsFor(double spacing) {
+    int bits = 64;
+    if (spacing > 0.0 && spacing < 1.0) {
+        bits += (int) std::ceil(-std::log2(spacing));
+    }
+    int limbs = 1 + (bits + 31) / 32;
+    return limbs > max_limbs ? max_limbs : limbs;
+}
@@ -0,0 +1,66 @@
+#ifndef MANDELBROTHIGHPRECISION_H
+#define MANDELBROTHIGHPRECISION_H
+
+#include <cstdint>
+#include <string>
+
+//HighPrecision is a signed fixed-point number with one 32-bit integer limb and up
+//to max_limbs-1 32-bit fraction limbs, stored most significant limb first in
+//two's complement. Everything in the mandelbrot is smaller than 2^31, so a fixed
+//binary point is all the deep zoom needs, and it keeps the arithmetic simple.
+//The number of limbs used is chosen per value, and operations on values with
+//different precisions use the larger one.
+class HighPrecision {
+    public:
+        static const int max_limbs = 32;
+
+        //zero, with the given number of limbs
+        HighPrecision(int limbs = 2);
+
+        //converts a double exactly (as far as the limbs allow)
+        HighPrecision(double value, int limbs);
+
+        //parses a decimal number like "-0.0134388705320121290283649", returns
+        //false if it isn't one. Numbers with an exponent are read as doubles
+        static bool parse(const std::string& text, int limbs, HighPrecision& value);
+
+        //Accesor functions:
+        int getLimbs() const {return limbs;}
+        bool isNegative() const {return (int32_t) limb[0] < 0;}
+
+        //converts to the nearest double
+        double toDouble() const;
+
+        //writes the number in decimal with the given number of fraction digits
+        std::string toString(int digits) const;
+
+        //returns a copy with a different number of limbs, truncating or padding
+        //the fraction
+        HighPrecision withLimbs(int limbs) const;
+
+        //Arithmetic:
+        HighPrecision operator+(const HighPrecision& other) const;
+        HighPrecision operator-(const HighPrecision& other) const;
+        HighPrecision operator*(const HighPrecision& other) const;
+        HighPrecision operator-() const;
+        HighPrecision& operator+=(double value);
+        bool operator==(const HighPrecision& other) const;
+        bool operator!=(const HighPrecision& other) const {return !(*this == other);}
+
+        //a hash of the value that doesn't change from run to run, and is the
+        //same for equal values with different numbers of limbs
+        uint64_t hash() const;
+
+        //returns the number of limbs needed to resolve the given spacing, with
+        //enough guard bits left over for a reference orbit
+        static int limbsFor(double spacing);
+
+    private:
+        int limbs;
+        uint32_t limb[max_limbs];
+
+        //the magnitude, for the operations that work on unsigned numbers
+        HighPrecision magnitude() const {return isNegative() ? -*this : *this;}
+};
+
+#endif
@@ -0,0 +1,1056 @@
+#include "mandelbrotKernels.h"
+
+#ifdef USE_SIMD_ALGORITHM
+#include <immintrin.h>
+#endif
+
+//this function calculates the escape-time of the given coordinate
+//it is the brain of the mandelbrot program: it does the work to
+//make the pretty pictures :)
+int escape(double x0, double y0, int max_iter, double cycle_tolerance) {
+    if (inCardioidOrBulb(x0, y0)) return max_iter;
+    double x = x0;
+    double y = y0;
+    double x2 = x*x;
+    double y2 = y*y;
+    double saved_x = x;
+    double saved_y = y;
+    double save = firstSave(0);
+    for (int iter = 0; iter < max_iter; ++iter) {
+        double tmp = 2.0 * x * y + y0;
+        x = x2 - y2 + x0;
+        y = tmp;
+        y2 = tmp*tmp;
+        x2 = x*x;
+        if (x2+y2 > 4.0) return iter+1;
+
+        //the orbit came back to where it was, so it is stuck in a cycle
+        double dx = x - saved_x;
+        double dy = y - saved_y;
+        if (dx*dx + dy*dy < cycle_tolerance) return max_iter;
+        if (iter+1 == save) {
+            saved_x = x;
+            saved_y = y;
+            save *= 2.0;
+        }
+    }
+    return max_iter;
+}
+
+//the scalar kernel runs the same loop as escape on each point, but starting
+//from the point's saved z
+static void escapeScalar(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    long long total = 0;
+    for (int i = 0; i < batch.count; i++) {
+        double x0 = batch.cx[i];
+        double y0 = batch.cy[i];
+        int iter = batch.iters[i];
+        if (iter < max_iter && inCardioidOrBulb(x0, y0)) {
+            batch.iters[i] = max_iter;
+            stats.interior++;
+            continue;
+        }
+
+        double x = batch.zx[i];
+        double y = batch.zy[i];
+        double x2 = x*x;
+        double y2 = y*y;
+        double saved_x = x;
+        double saved_y = y;
+        double save = firstSave(iter);
+        int start = iter;
+        bool cycle = false;
+        while (iter < max_iter) {
+            if (((iter - start) & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+            double tmp = 2.0 * x * y + y0;
+            x = x2 - y2 + x0;
+            y = tmp;
+            y2 = tmp*tmp;
+            x2 = x*x;
+            ++iter;
+            if (x2+y2 > 4.0) break;
+
+            double dx = x - saved_x;
+            double dy = y - saved_y;
+            if (dx*dx + dy*dy < cycle_tolerance) {
+                cycle = true;
+                break;
+            }
+            if (iter == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+        if (cycle && iter < max_iter) stats.periodic++;
+        batch.iters[i] = cycle ? max_iter : iter;
+        batch.zx[i] = x;
+        batch.zy[i] = y;
+        total += iter - start;
+    }
+    stats.iterations += total;
+    stats.lane_slots += total;
+}
+
+#ifdef USE_SIMD_ALGORITHM
+//The pairwise vector kernels iterate a group of points until all of them have
+//finished. Each lane counts its own iterations, and a lane that has escaped,
+//reached max_iter or been caught in a cycle is frozen so its z stays where it
+//finished. Points in the cardioid or bulb start out finished.
+//The last group is padded with copies of the last point, which aren't written back.
+
+//the SSE2 kernel does two points at a time
+static void escapeSSE2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d four = _mm_set1_pd(4.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d limit = _mm_set1_pd(max_iter);
+    const __m128d tolerance = _mm_set1_pd(cycle_tolerance);
+
+    for (int i = 0; i < batch.count; i += 2) {
+        if (isCancelled(batch)) return;
+        double lane[6][2];
+        int interior = 0;
+        for (int k = 0; k < 2; k++) {
+            int j = (i+k < batch.count) ? i+k : batch.count-1;
+            lane[0][k] = batch.cx[j];
+            lane[1][k] = batch.cy[j];
+            lane[2][k] = batch.zx[j];
+            lane[3][k] = batch.zy[j];
+            lane[4][k] = batch.iters[j];
+            if (batch.iters[j] < max_iter && inCardioidOrBulb(batch.cx[j], batch.cy[j])) {
+                lane[4][k] = max_iter;
+                interior |= 1 << k;
+            }
+            lane[5][k] = firstSave((int) lane[4][k]);
+        }
+
+        __m128d x_off = _mm_loadu_pd(lane[0]);
+        __m128d y_off = _mm_loadu_pd(lane[1]);
+        __m128d x = _mm_loadu_pd(lane[2]);
+        __m128d y = _mm_loadu_pd(lane[3]);
+        __m128d n = _mm_loadu_pd(lane[4]);
+        __m128d save = _mm_loadu_pd(lane[5]);
+        __m128d start = n;
+        __m128d x2 = _mm_mul_pd(x, x);
+        __m128d y2 = _mm_mul_pd(y, y);
+        __m128d saved_x = x;
+        __m128d saved_y = y;
+        __m128d active = _mm_cmplt_pd(n, limit);
+        __m128d cycle = _mm_setzero_pd();
+
+        long long steps = 0;
+        while (_mm_movemask_pd(active) != 0) {
+            __m128d tmp = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, x), y), y_off);
+            __m128d next = _mm_add_pd(_mm_sub_pd(x2, y2), x_off);
+            x = _mm_or_pd(_mm_and_pd(active, next), _mm_andnot_pd(active, x));
+            y = _mm_or_pd(_mm_and_pd(active, tmp), _mm_andnot_pd(active, y));
+            y2 = _mm_mul_pd(y, y);
+            x2 = _mm_mul_pd(x, x);
+            n = _mm_add_pd(n, _mm_and_pd(active, one));
+            steps++;
+            if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+            __m128d escaped = _mm_cmpgt_pd(_mm_add_pd(x2, y2), four);
+            active = _mm_andnot_pd(escaped, _mm_and_pd(active, _mm_cmplt_pd(n, limit)));
+
+            //freeze the lanes whose orbit came back to the saved z
+            __m128d dx = _mm_sub_pd(x, saved_x);
+            __m128d dy = _mm_sub_pd(y, saved_y);
+            __m128d dist = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+            __m128d same = _mm_and_pd(active, _mm_cmplt_pd(dist, tolerance));
+            cycle = _mm_or_pd(cycle, same);
+            active = _mm_andnot_pd(same, active);
+
+            __m128d hit = _mm_cmpeq_pd(n, save);
+            saved_x = _mm_or_pd(_mm_and_pd(hit, x), _mm_andnot_pd(hit, saved_x));
+            saved_y = _mm_or_pd(_mm_and_pd(hit, y), _mm_andnot_pd(hit, saved_y));
+            save = _mm_add_pd(save, _mm_and_pd(hit, save));
+        }
+
+        _mm_storeu_pd(lane[2], x);
+        _mm_storeu_pd(lane[3], y);
+        _mm_storeu_pd(lane[4], n);
+        _mm_storeu_pd(lane[0], _mm_sub_pd(n, start));
+        int periodic = _mm_movemask_pd(cycle);
+        for (int k = 0; k < 2 && i+k < batch.count; k++) {
+            batch.zx[i+k] = lane[2][k];
+            batch.zy[i+k] = lane[3][k];
+            batch.iters[i+k] = (periodic & (1 << k)) ? max_iter : (int) lane[4][k];
+            stats.iterations += (long long) lane[0][k];
+            stats.interior += (interior >> k) & 1;
+            stats.periodic += (periodic >> k) & 1;
+        }
+        stats.lane_slots += 2 * steps;
+    }
+}
+
+//the AVX2 kernel does four points at a time
+__attribute__ ((target ("avx2")))
+static void escapeAVX2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d limit = _mm256_set1_pd(max_iter);
+    const __m256d tolerance = _mm256_set1_pd(cycle_tolerance);
+
+    for (int i = 0; i < batch.count; i += 4) {
+        if (isCancelled(batch)) return;
+        double lane[6][4];
+        int interior = 0;
+        for (int k = 0; k < 4; k++) {
+            int j = (i+k < batch.count) ? i+k : batch.count-1;
+            lane[0][k] = batch.cx[j];
+            lane[1][k] = batch.cy[j];
+            lane[2][k] = batch.zx[j];
+            lane[3][k] = batch.zy[j];
+            lane[4][k] = batch.iters[j];
+            if (batch.iters[j] < max_iter && inCardioidOrBulb(batch.cx[j], batch.cy[j])) {
+                lane[4][k] = max_iter;
+                interior |= 1 << k;
+            }
+            lane[5][k] = firstSave((int) lane[4][k]);
+        }
+
+        __m256d x_off = _mm256_loadu_pd(lane[0]);
+        __m256d y_off = _mm256_loadu_pd(lane[1]);
+        __m256d x = _mm256_loadu_pd(lane[2]);
+        __m256d y = _mm256_loadu_pd(lane[3]);
+        __m256d n = _mm256_loadu_pd(lane[4]);
+        __m256d save = _mm256_loadu_pd(lane[5]);
+        __m256d start = n;
+        __m256d x2 = _mm256_mul_pd(x, x);
+        __m256d y2 = _mm256_mul_pd(y, y);
+        __m256d saved_x = x;
+        __m256d saved_y = y;
+        __m256d active = _mm256_cmp_pd(n, limit, _CMP_LT_OQ);
+        __m256d cycle = _mm256_setzero_pd();
+
+        long long steps = 0;
+        while (_mm256_movemask_pd(active) != 0) {
+            __m256d tmp = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), y_off);
+            __m256d next = _mm256_add_pd(_mm256_sub_pd(x2, y2), x_off);
+            x = _mm256_blendv_pd(x, next, active);
+            y = _mm256_blendv_pd(y, tmp, active);
+            y2 = _mm256_mul_pd(y, y);
+            x2 = _mm256_mul_pd(x, x);
+            n = _mm256_add_pd(n, _mm256_and_pd(active, one));
+            steps++;
+            if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+            __m256d escaped = _mm256_cmp_pd(_mm256_add_pd(x2, y2), four, _CMP_GT_OQ);
+            active = _mm256_andnot_pd(escaped, _mm256_and_pd(active, _mm256_cmp_pd(n, limit, _CMP_LT_OQ)));
+
+            //freeze the lanes whose orbit came back to the saved z
+            __m256d dx = _mm256_sub_pd(x, saved_x);
+            __m256d dy = _mm256_sub_pd(y, saved_y);
+            __m256d dist = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            __m256d same = _mm256_and_pd(active, _mm256_cmp_pd(dist, tolerance, _CMP_LT_OQ));
+            cycle = _mm256_or_pd(cycle, same);
+            active = _mm256_andnot_pd(same, active);
+
+            __m256d hit = _mm256_cmp_pd(n, save, _CMP_EQ_OQ);
+            saved_x = _mm256_blendv_pd(saved_x, x, hit);
+            saved_y = _mm256_blendv_pd(saved_y, y, hit);
+            save = _mm256_add_pd(save, _mm256_and_pd(hit, save));
+        }
+
+        _mm256_storeu_pd(lane[2], x);
+        _mm256_storeu_pd(lane[3], y);
+        _mm256_storeu_pd(lane[4], n);
+        _mm256_storeu_pd(lane[0], _mm256_sub_pd(n, start));
+        int periodic = _mm256_movemask_pd(cycle);
+        for (int k = 0; k < 4 && i+k < batch.count; k++) {
+            batch.zx[i+k] = lane[2][k];
+            batch.zy[i+k] = lane[3][k];
+            batch.iters[i+k] = (periodic & (1 << k)) ? max_iter : (int) lane[4][k];
+            stats.iterations += (long long) lane[0][k];
+            stats.interior += (interior >> k) & 1;
+            stats.periodic += (periodic >> k) & 1;
+        }
+        stats.lane_slots += 4 * steps;
+    }
+}
+
+//the AVX-512 kernel does eight points at a time
+__attribute__ ((target ("avx512f")))
+static void escapeAVX512(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d limit = _mm512_set1_pd(max_iter);
+    const __m512d tolerance = _mm512_set1_pd(cycle_tolerance);
+
+    for (int i = 0; i < batch.count; i += 8) {
+        if (isCancelled(batch)) return;
+        double lane[6][8];
+        int interior = 0;
+        for (int k = 0; k < 8; k++) {
+            int j = (i+k < batch.count) ? i+k : batch.count-1;
+            lane[0][k] = batch.cx[j];
+            lane[1][k] = batch.cy[j];
+            lane[2][k] = batch.zx[j];
+            lane[3][k] = batch.zy[j];
+            lane[4][k] = batch.iters[j];
+            if (batch.iters[j] < max_iter && inCardioidOrBulb(batch.cx[j], batch.cy[j])) {
+                lane[4][k] = max_iter;
+                interior |= 1 << k;
+            }
+            lane[5][k] = firstSave((int) lane[4][k]);
+        }
+
+        __m512d x_off = _mm512_loadu_pd(lane[0]);
+        __m512d y_off = _mm512_loadu_pd(lane[1]);
+        __m512d x = _mm512_loadu_pd(lane[2]);
+        __m512d y = _mm512_loadu_pd(lane[3]);
+        __m512d n = _mm512_loadu_pd(lane[4]);
+        __m512d save = _mm512_loadu_pd(lane[5]);
+        __m512d start = n;
+        __m512d x2 = _mm512_mul_pd(x, x);
+        __m512d y2 = _mm512_mul_pd(y, y);
+        __m512d saved_x = x;
+        __m512d saved_y = y;
+        __mmask8 active = _mm512_cmp_pd_mask(n, limit, _CMP_LT_OQ);
+        __mmask8 cycle = 0;
+
+        long long steps = 0;
+        while (active != 0) {
+            __m512d tmp = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), y_off);
+            x = _mm512_mask_add_pd(x, active, _mm512_sub_pd(x2, y2), x_off);
+            y = _mm512_mask_mov_pd(y, active, tmp);
+            y2 = _mm512_mul_pd(y, y);
+            x2 = _mm512_mul_pd(x, x);
+            n = _mm512_mask_add_pd(n, active, n, one);
+            steps++;
+            if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+            __mmask8 escaped = _mm512_cmp_pd_mask(_mm512_add_pd(x2, y2), four, _CMP_GT_OQ);
+            active &= ~escaped & _mm512_cmp_pd_mask(n, limit, _CMP_LT_OQ);
+
+            //freeze the lanes whose orbit came back to the saved z
+            __m512d dx = _mm512_sub_pd(x, saved_x);
+            __m512d dy = _mm512_sub_pd(y, saved_y);
+            __m512d dist = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+            __mmask8 same = active & _mm512_cmp_pd_mask(dist, tolerance, _CMP_LT_OQ);
+            cycle |= same;
+            active &= ~same;
+
+            __mmask8 hit = _mm512_cmp_pd_mask(n, save, _CMP_EQ_OQ);
+            saved_x = _mm512_mask_mov_pd(saved_x, hit, x);
+            saved_y = _mm512_mask_mov_pd(saved_y, hit, y);
+            save = _mm512_mask_add_pd(save, hit, save, save);
+        }
+
+        _mm512_storeu_pd(lane[2], x);
+        _mm512_storeu_pd(lane[3], y);
+        _mm512_storeu_pd(lane[4], n);
+        _mm512_storeu_pd(lane[0], _mm512_sub_pd(n, start));
+        for (int k = 0; k < 8 && i+k < batch.count; k++) {
+            batch.zx[i+k] = lane[2][k];
+            batch.zy[i+k] = lane[3][k];
+            batch.iters[i+k] = (cycle & (1 << k)) ? max_iter : (int) lane[4][k];
+            stats.iterations += (long long) lane[0][k];
+            stats.interior += (interior >> k) & 1;
+            stats.periodic += (cycle >> k) & 1;
+        }
+        stats.lane_slots += 8 * steps;
+    }
+}
+
+//The refilling kernels work through the whole batch as a queue. Every lane has its
+//own iteration count, and as soon as a lane's point escapes or reaches max_iter
+//its result is written out and the lane is given the next pending point. The
+//lanes only go idle once the queue is empty.
+
+//LaneQueue keeps track of which point each of the N lanes is working on. The
+//kernels store their vectors into it when some lanes finish, let it retire and
+//refill those lanes, then load the vectors back. T is the type of the lanes,
+//double or float. saved_x, saved_y and save are each lane's cycle check
+template <typename T, int N>
+struct LaneQueue {
+    T cx[N], cy[N], x[N], y[N], n[N];
+    T saved_x[N], saved_y[N], save[N];
+    int start[N];
+    int point[N];
+    int next;
+    int running;
+
+    //fills the lanes with the first N points. Lanes without a point iterate
+    //z = 0, c = 0, which never escapes
+    void begin(const EscapeBatch& batch, int max_iter, KernelStats& stats) {
+        next = 0;
+        running = 0;
+        for (int k = 0; k < N; k++) {
+            load(k, batch, max_iter, stats);
+        }
+    }
+
+    //gives lane k the next pending point, if there is one. Points that are
+    //already at max_iter are skipped, and points in the cardioid or bulb are
+    //finished right away
+    void load(int k, const EscapeBatch& batch, int max_iter, KernelStats& stats) {
+        for (; next < batch.count; next++) {
+            if (batch.iters[next] >= max_iter) continue;
+            if (!inCardioidOrBulb(batch.cx[next], batch.cy[next])) break;
+            batch.iters[next] = max_iter;
+            stats.interior++;
+        }
+        if (next >= batch.count) {
+            point[k] = -1;
+            cx[k] = cy[k] = x[k] = y[k] = n[k] = 0;
+
+            //an idle lane never saves z, so it is never caught in a cycle
+            saved_x[k] = saved_y[k] = 4;
+            save[k] = -1;
+            return;
+        }
+        point[k] = next;
+        cx[k] = (T) batch.cx[next];
+        cy[k] = (T) batch.cy[next];
+        x[k] = (T) batch.zx[next];
+        y[k] = (T) batch.zy[next];
+        start[k] = batch.iters[next];
+        n[k] = start[k];
+        saved_x[k] = x[k];
+        saved_y[k] = y[k];
+        save[k] = (T) firstSave(start[k]);
+        next++;
+        running++;
+    }
+
+    //writes out the results of the finished lanes in mask, and refills them.
+    //The lanes in cycle were caught in a cycle, so they never escape
+    void retire(int mask, int cycle, const EscapeBatch& batch, int max_iter, KernelStats& stats) {
+        for (int k = 0; k < N; k++) {
+            if (!(mask & (1 << k))) continue;
+
+            //idle lanes also finish every max_iter iterations, they just
+            //start over without a result
+            if (point[k] >= 0) {
+                bool periodic = (cycle & (1 << k)) != 0;
+                batch.iters[point[k]] = periodic ? max_iter : (int) n[k];
+                batch.zx[point[k]] = x[k];
+                batch.zy[point[k]] = y[k];
+                stats.iterations += (int) n[k] - start[k];
+                stats.periodic += periodic;
+                running--;
+            }
+            load(k, batch, max_iter, stats);
+        }
+    }
+};
+
+//the refilling SSE2 kernel does two points at a time
+static void escapeRefillSSE2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d four = _mm_set1_pd(4.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d limit = _mm_set1_pd(max_iter);
+    const __m128d tolerance = _mm_set1_pd(cycle_tolerance);
+
+    LaneQueue<double, 2> q;
+    q.begin(batch, max_iter, stats);
+    __m128d cx = _mm_loadu_pd(q.cx);
+    __m128d cy = _mm_loadu_pd(q.cy);
+    __m128d x = _mm_loadu_pd(q.x);
+    __m128d y = _mm_loadu_pd(q.y);
+    __m128d n = _mm_loadu_pd(q.n);
+    __m128d saved_x = _mm_loadu_pd(q.saved_x);
+    __m128d saved_y = _mm_loadu_pd(q.saved_y);
+    __m128d save = _mm_loadu_pd(q.save);
+    __m128d x2 = _mm_mul_pd(x, x);
+    __m128d y2 = _mm_mul_pd(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m128d tmp = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, x), y), cy);
+        x = _mm_add_pd(_mm_sub_pd(x2, y2), cx);
+        y = tmp;
+        y2 = _mm_mul_pd(y, y);
+        x2 = _mm_mul_pd(x, x);
+        n = _mm_add_pd(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m128d dx = _mm_sub_pd(x, saved_x);
+        __m128d dy = _mm_sub_pd(y, saved_y);
+        __m128d dist = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        __m128d same = _mm_cmplt_pd(dist, tolerance);
+        __m128d hit = _mm_cmpeq_pd(n, save);
+        saved_x = _mm_or_pd(_mm_and_pd(hit, x), _mm_andnot_pd(hit, saved_x));
+        saved_y = _mm_or_pd(_mm_and_pd(hit, y), _mm_andnot_pd(hit, saved_y));
+        save = _mm_add_pd(save, _mm_and_pd(hit, save));
+
+        int finished = _mm_movemask_pd(_mm_or_pd(_mm_cmpgt_pd(_mm_add_pd(x2, y2), four), _mm_cmpge_pd(n, limit)));
+        int cycle = _mm_movemask_pd(same) & ~finished;
+        int mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm_storeu_pd(q.x, x);
+        _mm_storeu_pd(q.y, y);
+        _mm_storeu_pd(q.n, n);
+        _mm_storeu_pd(q.saved_x, saved_x);
+        _mm_storeu_pd(q.saved_y, saved_y);
+        _mm_storeu_pd(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm_loadu_pd(q.cx);
+        cy = _mm_loadu_pd(q.cy);
+        x = _mm_loadu_pd(q.x);
+        y = _mm_loadu_pd(q.y);
+        n = _mm_loadu_pd(q.n);
+        saved_x = _mm_loadu_pd(q.saved_x);
+        saved_y = _mm_loadu_pd(q.saved_y);
+        save = _mm_loadu_pd(q.save);
+        x2 = _mm_mul_pd(x, x);
+        y2 = _mm_mul_pd(y, y);
+    }
+    stats.lane_slots += 2 * steps;
+}
+
+//the refilling AVX2 kernel does four points at a time
+__attribute__ ((target ("avx2")))
+static void escapeRefillAVX2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d limit = _mm256_set1_pd(max_iter);
+    const __m256d tolerance = _mm256_set1_pd(cycle_tolerance);
+
+    LaneQueue<double, 4> q;
+    q.begin(batch, max_iter, stats);
+    __m256d cx = _mm256_loadu_pd(q.cx);
+    __m256d cy = _mm256_loadu_pd(q.cy);
+    __m256d x = _mm256_loadu_pd(q.x);
+    __m256d y = _mm256_loadu_pd(q.y);
+    __m256d n = _mm256_loadu_pd(q.n);
+    __m256d saved_x = _mm256_loadu_pd(q.saved_x);
+    __m256d saved_y = _mm256_loadu_pd(q.saved_y);
+    __m256d save = _mm256_loadu_pd(q.save);
+    __m256d x2 = _mm256_mul_pd(x, x);
+    __m256d y2 = _mm256_mul_pd(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m256d tmp = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), cy);
+        x = _mm256_add_pd(_mm256_sub_pd(x2, y2), cx);
+        y = tmp;
+        y2 = _mm256_mul_pd(y, y);
+        x2 = _mm256_mul_pd(x, x);
+        n = _mm256_add_pd(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m256d dx = _mm256_sub_pd(x, saved_x);
+        __m256d dy = _mm256_sub_pd(y, saved_y);
+        __m256d dist = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        __m256d same = _mm256_cmp_pd(dist, tolerance, _CMP_LT_OQ);
+        __m256d hit = _mm256_cmp_pd(n, save, _CMP_EQ_OQ);
+        saved_x = _mm256_blendv_pd(saved_x, x, hit);
+        saved_y = _mm256_blendv_pd(saved_y, y, hit);
+        save = _mm256_add_pd(save, _mm256_and_pd(hit, save));
+
+        int finished = _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(_mm256_add_pd(x2, y2), four, _CMP_GT_OQ), _mm256_cmp_pd(n, limit, _CMP_GE_OQ)));
+        int cycle = _mm256_movemask_pd(same) & ~finished;
+        int mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm256_storeu_pd(q.x, x);
+        _mm256_storeu_pd(q.y, y);
+        _mm256_storeu_pd(q.n, n);
+        _mm256_storeu_pd(q.saved_x, saved_x);
+        _mm256_storeu_pd(q.saved_y, saved_y);
+        _mm256_storeu_pd(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm256_loadu_pd(q.cx);
+        cy = _mm256_loadu_pd(q.cy);
+        x = _mm256_loadu_pd(q.x);
+        y = _mm256_loadu_pd(q.y);
+        n = _mm256_loadu_pd(q.n);
+        saved_x = _mm256_loadu_pd(q.saved_x);
+        saved_y = _mm256_loadu_pd(q.saved_y);
+        save = _mm256_loadu_pd(q.save);
+        x2 = _mm256_mul_pd(x, x);
+        y2 = _mm256_mul_pd(y, y);
+    }
+    stats.lane_slots += 4 * steps;
+}
+
+//the refilling AVX-512 kernel does eight points at a time
+__attribute__ ((target ("avx512f")))
+static void escapeRefillAVX512(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d limit = _mm512_set1_pd(max_iter);
+    const __m512d tolerance = _mm512_set1_pd(cycle_tolerance);
+
+    LaneQueue<double, 8> q;
+    q.begin(batch, max_iter, stats);
+    __m512d cx = _mm512_loadu_pd(q.cx);
+    __m512d cy = _mm512_loadu_pd(q.cy);
+    __m512d x = _mm512_loadu_pd(q.x);
+    __m512d y = _mm512_loadu_pd(q.y);
+    __m512d n = _mm512_loadu_pd(q.n);
+    __m512d saved_x = _mm512_loadu_pd(q.saved_x);
+    __m512d saved_y = _mm512_loadu_pd(q.saved_y);
+    __m512d save = _mm512_loadu_pd(q.save);
+    __m512d x2 = _mm512_mul_pd(x, x);
+    __m512d y2 = _mm512_mul_pd(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m512d tmp = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), cy);
+        x = _mm512_add_pd(_mm512_sub_pd(x2, y2), cx);
+        y = tmp;
+        y2 = _mm512_mul_pd(y, y);
+        x2 = _mm512_mul_pd(x, x);
+        n = _mm512_add_pd(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m512d dx = _mm512_sub_pd(x, saved_x);
+        __m512d dy = _mm512_sub_pd(y, saved_y);
+        __m512d dist = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+        __mmask8 same = _mm512_cmp_pd_mask(dist, tolerance, _CMP_LT_OQ);
+        __mmask8 hit = _mm512_cmp_pd_mask(n, save, _CMP_EQ_OQ);
+        saved_x = _mm512_mask_mov_pd(saved_x, hit, x);
+        saved_y = _mm512_mask_mov_pd(saved_y, hit, y);
+        save = _mm512_mask_add_pd(save, hit, save, save);
+
+        __mmask8 finished = _mm512_cmp_pd_mask(_mm512_add_pd(x2, y2), four, _CMP_GT_OQ)
+                      | _mm512_cmp_pd_mask(n, limit, _CMP_GE_OQ);
+        __mmask8 cycle = same & ~finished;
+        __mmask8 mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm512_storeu_pd(q.x, x);
+        _mm512_storeu_pd(q.y, y);
+        _mm512_storeu_pd(q.n, n);
+        _mm512_storeu_pd(q.saved_x, saved_x);
+        _mm512_storeu_pd(q.saved_y, saved_y);
+        _mm512_storeu_pd(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm512_loadu_pd(q.cx);
+        cy = _mm512_loadu_pd(q.cy);
+        x = _mm512_loadu_pd(q.x);
+        y = _mm512_loadu_pd(q.y);
+        n = _mm512_loadu_pd(q.n);
+        saved_x = _mm512_loadu_pd(q.saved_x);
+        saved_y = _mm512_loadu_pd(q.saved_y);
+        save = _mm512_loadu_pd(q.save);
+        x2 = _mm512_mul_pd(x, x);
+        y2 = _mm512_mul_pd(y, y);
+    }
+    stats.lane_slots += 8 * steps;
+}
+
+//The float kernels are the same as the refilling double kernels, with twice as
+//many lanes. Float only has 24 bits, so they are for shallow views, where the
+//pixels are much further apart than that
+static void escapeFloatSSE2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 limit = _mm_set1_ps(max_iter);
+    const __m128 tolerance = _mm_set1_ps((float) cycle_tolerance);
+
+    LaneQueue<float, 4> q;
+    q.begin(batch, max_iter, stats);
+    __m128 cx = _mm_loadu_ps(q.cx);
+    __m128 cy = _mm_loadu_ps(q.cy);
+    __m128 x = _mm_loadu_ps(q.x);
+    __m128 y = _mm_loadu_ps(q.y);
+    __m128 n = _mm_loadu_ps(q.n);
+    __m128 saved_x = _mm_loadu_ps(q.saved_x);
+    __m128 saved_y = _mm_loadu_ps(q.saved_y);
+    __m128 save = _mm_loadu_ps(q.save);
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 y2 = _mm_mul_ps(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m128 tmp = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, x), y), cy);
+        x = _mm_add_ps(_mm_sub_ps(x2, y2), cx);
+        y = tmp;
+        y2 = _mm_mul_ps(y, y);
+        x2 = _mm_mul_ps(x, x);
+        n = _mm_add_ps(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m128 dx = _mm_sub_ps(x, saved_x);
+        __m128 dy = _mm_sub_ps(y, saved_y);
+        __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 same = _mm_cmplt_ps(dist, tolerance);
+        __m128 hit = _mm_cmpeq_ps(n, save);
+        saved_x = _mm_or_ps(_mm_and_ps(hit, x), _mm_andnot_ps(hit, saved_x));
+        saved_y = _mm_or_ps(_mm_and_ps(hit, y), _mm_andnot_ps(hit, saved_y));
+        save = _mm_add_ps(save, _mm_and_ps(hit, save));
+
+        int finished = _mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(_mm_add_ps(x2, y2), four), _mm_cmpge_ps(n, limit)));
+        int cycle = _mm_movemask_ps(same) & ~finished;
+        int mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm_storeu_ps(q.x, x);
+        _mm_storeu_ps(q.y, y);
+        _mm_storeu_ps(q.n, n);
+        _mm_storeu_ps(q.saved_x, saved_x);
+        _mm_storeu_ps(q.saved_y, saved_y);
+        _mm_storeu_ps(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm_loadu_ps(q.cx);
+        cy = _mm_loadu_ps(q.cy);
+        x = _mm_loadu_ps(q.x);
+        y = _mm_loadu_ps(q.y);
+        n = _mm_loadu_ps(q.n);
+        saved_x = _mm_loadu_ps(q.saved_x);
+        saved_y = _mm_loadu_ps(q.saved_y);
+        save = _mm_loadu_ps(q.save);
+        x2 = _mm_mul_ps(x, x);
+        y2 = _mm_mul_ps(y, y);
+    }
+    stats.lane_slots += 4 * steps;
+}
+
+__attribute__ ((target ("avx2")))
+static void escapeFloatAVX2(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 limit = _mm256_set1_ps(max_iter);
+    const __m256 tolerance = _mm256_set1_ps((float) cycle_tolerance);
+
+    LaneQueue<float, 8> q;
+    q.begin(batch, max_iter, stats);
+    __m256 cx = _mm256_loadu_ps(q.cx);
+    __m256 cy = _mm256_loadu_ps(q.cy);
+    __m256 x = _mm256_loadu_ps(q.x);
+    __m256 y = _mm256_loadu_ps(q.y);
+    __m256 n = _mm256_loadu_ps(q.n);
+    __m256 saved_x = _mm256_loadu_ps(q.saved_x);
+    __m256 saved_y = _mm256_loadu_ps(q.saved_y);
+    __m256 save = _mm256_loadu_ps(q.save);
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 y2 = _mm256_mul_ps(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m256 tmp = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, x), y), cy);
+        x = _mm256_add_ps(_mm256_sub_ps(x2, y2), cx);
+        y = tmp;
+        y2 = _mm256_mul_ps(y, y);
+        x2 = _mm256_mul_ps(x, x);
+        n = _mm256_add_ps(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m256 dx = _mm256_sub_ps(x, saved_x);
+        __m256 dy = _mm256_sub_ps(y, saved_y);
+        __m256 dist = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 same = _mm256_cmp_ps(dist, tolerance, _CMP_LT_OQ);
+        __m256 hit = _mm256_cmp_ps(n, save, _CMP_EQ_OQ);
+        saved_x = _mm256_blendv_ps(saved_x, x, hit);
+        saved_y = _mm256_blendv_ps(saved_y, y, hit);
+        save = _mm256_add_ps(save, _mm256_and_ps(hit, save));
+
+        int finished = _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(x2, y2), four, _CMP_GT_OQ), _mm256_cmp_ps(n, limit, _CMP_GE_OQ)));
+        int cycle = _mm256_movemask_ps(same) & ~finished;
+        int mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm256_storeu_ps(q.x, x);
+        _mm256_storeu_ps(q.y, y);
+        _mm256_storeu_ps(q.n, n);
+        _mm256_storeu_ps(q.saved_x, saved_x);
+        _mm256_storeu_ps(q.saved_y, saved_y);
+        _mm256_storeu_ps(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm256_loadu_ps(q.cx);
+        cy = _mm256_loadu_ps(q.cy);
+        x = _mm256_loadu_ps(q.x);
+        y = _mm256_loadu_ps(q.y);
+        n = _mm256_loadu_ps(q.n);
+        saved_x = _mm256_loadu_ps(q.saved_x);
+        saved_y = _mm256_loadu_ps(q.saved_y);
+        save = _mm256_loadu_ps(q.save);
+        x2 = _mm256_mul_ps(x, x);
+        y2 = _mm256_mul_ps(y, y);
+    }
+    stats.lane_slots += 8 * steps;
+}
+
+__attribute__ ((target ("avx512f")))
+static void escapeFloatAVX512(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    const __m512 two = _mm512_set1_ps(2.0f);
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 limit = _mm512_set1_ps(max_iter);
+    const __m512 tolerance = _mm512_set1_ps((float) cycle_tolerance);
+
+    LaneQueue<float, 16> q;
+    q.begin(batch, max_iter, stats);
+    __m512 cx = _mm512_loadu_ps(q.cx);
+    __m512 cy = _mm512_loadu_ps(q.cy);
+    __m512 x = _mm512_loadu_ps(q.x);
+    __m512 y = _mm512_loadu_ps(q.y);
+    __m512 n = _mm512_loadu_ps(q.n);
+    __m512 saved_x = _mm512_loadu_ps(q.saved_x);
+    __m512 saved_y = _mm512_loadu_ps(q.saved_y);
+    __m512 save = _mm512_loadu_ps(q.save);
+    __m512 x2 = _mm512_mul_ps(x, x);
+    __m512 y2 = _mm512_mul_ps(y, y);
+    long long steps = 0;
+
+    while (q.running > 0) {
+        __m512 tmp = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(two, x), y), cy);
+        x = _mm512_add_ps(_mm512_sub_ps(x2, y2), cx);
+        y = tmp;
+        y2 = _mm512_mul_ps(y, y);
+        x2 = _mm512_mul_ps(x, x);
+        n = _mm512_add_ps(n, one);
+        steps++;
+        if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+        //compare z with the saved z, then save it if n is the lane's next
+        //power of two
+        __m512 dx = _mm512_sub_ps(x, saved_x);
+        __m512 dy = _mm512_sub_ps(y, saved_y);
+        __m512 dist = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+        __mmask16 same = _mm512_cmp_ps_mask(dist, tolerance, _CMP_LT_OQ);
+        __mmask16 hit = _mm512_cmp_ps_mask(n, save, _CMP_EQ_OQ);
+        saved_x = _mm512_mask_mov_ps(saved_x, hit, x);
+        saved_y = _mm512_mask_mov_ps(saved_y, hit, y);
+        save = _mm512_mask_add_ps(save, hit, save, save);
+
+        __mmask16 finished = _mm512_cmp_ps_mask(_mm512_add_ps(x2, y2), four, _CMP_GT_OQ)
+                       | _mm512_cmp_ps_mask(n, limit, _CMP_GE_OQ);
+        __mmask16 cycle = same & ~finished;
+        __mmask16 mask = finished | cycle;
+        if (mask == 0) continue;
+
+        _mm512_storeu_ps(q.x, x);
+        _mm512_storeu_ps(q.y, y);
+        _mm512_storeu_ps(q.n, n);
+        _mm512_storeu_ps(q.saved_x, saved_x);
+        _mm512_storeu_ps(q.saved_y, saved_y);
+        _mm512_storeu_ps(q.save, save);
+        q.retire(mask, cycle, batch, max_iter, stats);
+        cx = _mm512_loadu_ps(q.cx);
+        cy = _mm512_loadu_ps(q.cy);
+        x = _mm512_loadu_ps(q.x);
+        y = _mm512_loadu_ps(q.y);
+        n = _mm512_loadu_ps(q.n);
+        saved_x = _mm512_loadu_ps(q.saved_x);
+        saved_y = _mm512_loadu_ps(q.saved_y);
+        save = _mm512_loadu_ps(q.save);
+        x2 = _mm512_mul_ps(x, x);
+        y2 = _mm512_mul_ps(y, y);
+    }
+    stats.lane_slots += 16 * steps;
+}
+#endif
+
+//the scalar float kernel, for when there are no vector kernels
+static void escapeFloatScalar(const EscapeBatch& batch, int max_iter, double cycle_tolerance, KernelStats& stats) {
+    long long total = 0;
+    for (int i = 0; i < batch.count; i++) {
+        int iter = batch.iters[i];
+        if (iter < max_iter && inCardioidOrBulb(batch.cx[i], batch.cy[i])) {
+            batch.iters[i] = max_iter;
+            stats.interior++;
+            continue;
+        }
+
+        float x0 = (float) batch.cx[i];
+        float y0 = (float) batch.cy[i];
+        float x = (float) batch.zx[i];
+        float y = (float) batch.zy[i];
+        float x2 = x*x;
+        float y2 = y*y;
+        float saved_x = x;
+        float saved_y = y;
+        double save = firstSave(iter);
+        int start = iter;
+        bool cycle = false;
+        while (iter < max_iter) {
+            if (((iter - start) & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+            float tmp = 2.0f * x * y + y0;
+            x = x2 - y2 + x0;
+            y = tmp;
+            y2 = tmp*tmp;
+            x2 = x*x;
+            ++iter;
+            if (x2+y2 > 4.0f) break;
+
+            float dx = x - saved_x;
+            float dy = y - saved_y;
+            if (dx*dx + dy*dy < (float) cycle_tolerance) {
+                cycle = true;
+                break;
+            }
+            if (iter == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+        if (cycle && iter < max_iter) stats.periodic++;
+        batch.iters[i] = cycle ? max_iter : iter;
+        batch.zx[i] = x;
+        batch.zy[i] = y;
+        total += iter - start;
+    }
+    stats.iterations += total;
+    stats.lane_slots += total;
+}
+
+//returns the kernel function for the given type
+EscapeKernel getKernel(KernelType type, bool refill) {
+#ifdef USE_SIMD_ALGORITHM
+    switch (type) {
+        case KERNEL_SSE2:
+            return refill ? &escapeRefillSSE2 : &escapeSSE2;
+        case KERNEL_AVX2:
+            return refill ? &escapeRefillAVX2 : &escapeAVX2;
+        case KERNEL_AVX512:
+            return refill ? &escapeRefillAVX512 : &escapeAVX512;
+        default:
+            break;
+    }
+#else
+    (void) type;
+    (void) refill;
+#endif
+    return &escapeScalar;
+}
+
+//returns the float kernel for the given type
+EscapeKernel getFloatKernel(KernelType type) {
+#ifdef USE_SIMD_ALGORITHM
+    switch (type) {
+        case KERNEL_SSE2:
+            return &escapeFloatSSE2;
+        case KERNEL_AVX2:
+            return &escapeFloatAVX2;
+        case KERNEL_AVX512:
+            return &escapeFloatAVX512;
+        default:
+            break;
+    }
+#else
+    (void) type;
+#endif
+    return &escapeFloatScalar;
+}
+
+//looks up one color at a time
+static void colorScalar(const int *iters, int count, const uint32_t *table, int table_size,
+                        uint32_t *colors) {
+    int last = table_size - 1;
+    for (int i = 0; i < count; i++) {
+        colors[i] = table[iters[i] < last ? iters[i] : last];
+    }
+}
+
+#ifdef USE_SIMD_ALGORITHM
+//the AVX2 color kernel gathers eight colors at a time
+__attribute__ ((target ("avx2")))
+static void colorAVX2(const int *iters, int count, const uint32_t *table, int table_size,
+                      uint32_t *colors) {
+    const __m256i last = _mm256_set1_epi32(table_size - 1);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i *) &iters[i]);
+        index = _mm256_min_epi32(index, last);
+        __m256i color = _mm256_i32gather_epi32((const int *) table, index, 4);
+        _mm256_storeu_si256((__m256i *) &colors[i], color);
+    }
+    colorScalar(iters + i, count - i, table, table_size, colors + i);
+}
+
+//the AVX-512 color kernel gathers sixteen colors at a time
+__attribute__ ((target ("avx512f")))
+static void colorAVX512(const int *iters, int count, const uint32_t *table, int table_size,
+                        uint32_t *colors) {
+    const __m512i last = _mm512_set1_epi32(table_size - 1);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i index = _mm512_loadu_si512((const void *) &iters[i]);
+        index = _mm512_min_epi32(index, last);
+        __m512i color = _mm512_i32gather_epi32(index, (const void *) table, 4);
+        _mm512_storeu_si512((void *) &colors[i], color);
+    }
+    colorScalar(iters + i, count - i, table, table_size, colors + i);
+}
+#endif
+
+//returns the color kernel for the given type
+ColorKernel getColorKernel(KernelType type) {
+#ifdef USE_SIMD_ALGORITHM
+    switch (type) {
+        case KERNEL_AVX2:
+            return &colorAVX2;
+        case KERNEL_AVX512:
+            return &colorAVX512;
+        default:
+            break;
+    }
+#else
+    (void) type;
+#endif
+    return &colorScalar;
+}
+
+//checks cpuid for the instructions each kernel needs
+bool kernelSupported(KernelType type) {
+    switch (type) {
+        case KERNEL_SCALAR:
+            return true;
+#ifdef USE_SIMD_ALGORITHM
+        case KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+//picks the fastest supported kernel
+KernelType detectKernel() {
+    for (int type = KERNEL_COUNT-1; type > KERNEL_SCALAR; type--) {
+        if (kernelSupported((KernelType) type)) return (KernelType) type;
+    }
+    return KERNEL_SCALAR;
+}
+
+static const char *kernel_names[KERNEL_COUNT] = {"scalar", "sse2", "avx2", "avx512"};
+
+const char *kernelName(KernelType type) {
+    if (type < 0 || type >= KERNEL_COUNT) return "unknown";
+    return kernel_names[type];
+}
+
+bool parseKernel(const std::string& name, KernelType& type) {
+    for (int i = 0; i < KERNEL_COUNT; i++) {
+        if (name == kernel_names[i]) {
+            type = (KernelType) i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,142 @@
+#ifndef MANDELBROTKERNELS_H
+#define MANDELBROTKERNELS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//The escape kernels calculate the escape-time of a batch of points. They all give
+//exactly the same result for the same point: z starts at c, and the escape time
+//is the number of iterations until |z| > 2, or max_iter if it never escapes.
+//The vector kernels only differ in how many points they iterate at once.
+//Because a point's orbit doesn't depend on max_iter, a point that reached max_iter
+//can be resumed from its final z later, and give the same result as if it had
+//been started over with the higher max_iter.
+//Points that can be shown never to escape are given max_iter right away: the
+//ones in the main cardioid or the period-2 bulb before iterating at all, and
+//the ones whose orbit comes back to an earlier point, which means it is stuck
+//in a cycle. Their z is left where it was, so resuming them ends the same way.
+
+//the kinds of kernel, from slowest to fastest
+enum KernelType {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_COUNT
+};
+
+//counters the kernels add to, to see how well they keep the vector lanes busy.
+//lane_slots is the number of vector iterations times the number of lanes, so
+//iterations / lane_slots is the lane utilization. interior and periodic are
+//the points the cardioid/bulb test and the cycle check finished early.
+//rebases and skipped (the iterations series approximation saved) are only
+//counted by the perturbation kernel
+struct KernelStats {
+    long long iterations;
+    long long lane_slots;
+    long long interior;
+    long long periodic;
+    long long rebases;
+    long long skipped;
+};
+
+//a batch of points for a kernel. Each point has coordinates (cx[i], cy[i]) and
+//starts from z = (zx[i], zy[i]) with iters[i] iterations already done, which is
+//z = c and 0 iterations for a new point. The kernel writes the escape time back
+//to iters and the final z back to zx and zy. If cancel is set, the kernel looks
+//at it every cancel_interval steps and returns as soon as it is true, with the
+//batch left half done
+struct EscapeBatch {
+    const double *cx;
+    const double *cy;
+    double *zx;
+    double *zy;
+    int *iters;
+    int count;
+    const std::atomic<bool> *cancel;
+};
+
+//how often the kernels check for cancel, in iterations of one point or steps of
+//the vector lanes. It is a power of 2, so the check is a mask
+static const int cancel_interval = 4096;
+
+//true if the batch was cancelled. The flag only stops the work, so it doesn't
+//need any ordering with the rest of memory
+inline bool isCancelled(const EscapeBatch& batch) {
+    return batch.cancel != NULL && batch.cancel->load(std::memory_order_relaxed);
+}
+
+//true if c is in the main cardioid or the period-2 bulb. Those points never
+//escape, and they are most of the inside of the set
+inline bool inCardioidOrBulb(double x, double y) {
+    double y2 = y*y;
+    double q = (x - 0.25)*(x - 0.25) + y2;
+    if (q * (q + (x - 0.25)) <= 0.25 * y2) return true;
+    return (x + 1.0)*(x + 1.0) + y2 <= 0.0625;
+}
+
+//the iteration at which the cycle check first saves z, the next power of two
+//after start. z is saved again at every power of two after that, so the window
+//the orbit has to repeat in doubles each time, like Brent's cycle detection
+inline double firstSave(int start) {
+    double save = 1.0;
+    while (save <= start) save *= 2.0;
+    return save;
+}
+
+//the squared distance under which the cycle checks take two points of an orbit
+//to be the same point of a cycle, for pixels spacing apart. Orbits of points
+//just outside the set linger near repelling cycles and crawl past parabolic
+//points, coming back to within any fixed tolerance of where they were, so it
+//is a thousandth of the spacing
+inline double cycleTolerance(double spacing) {
+    return 1e-6 * spacing * spacing;
+}
+
+//an escape kernel iterates every point of the batch until it escapes or reaches
+//max_iter, or comes back to within cycle_tolerance (see cycleTolerance) of
+//where it was
+typedef void (*EscapeKernel)(const EscapeBatch& batch, int max_iter, double cycle_tolerance,
+                             KernelStats& stats);
+
+//escape calculates the escape-time of a single point. It is the fallback for
+//when the vector kernels aren't available
+int escape(double x0, double y0, int max_iter, double cycle_tolerance);
+
+//returns the kernel function for the given type. The refilling vector kernels
+//give a lane the next pending point as soon as its point is finished, instead
+//of waiting for the whole group to escape
+EscapeKernel getKernel(KernelType type, bool refill);
+
+//returns the single precision version of a kernel, which has twice the lanes.
+//The float kernels always refill their lanes, and a point's float orbit is
+//saved in zx and zy as doubles, so it can be resumed exactly
+EscapeKernel getFloatKernel(KernelType type);
+
+//the vector float kernels count iterations in floats, which only hold every
+//whole number up to 2^24, so they can't go to a higher max_iter
+static const int float_max_iter = 1 << 24;
+
+//a color kernel looks up the packed RGBA colors of count escape times in a
+//table of table_size colors. Escape times past the end of the table get its
+//last color. The vector kernels gather 8 or 16 colors at once
+typedef void (*ColorKernel)(const int *iters, int count, const uint32_t *table, int table_size,
+                            uint32_t *colors);
+
+//returns the color kernel for the given type. SSE2 has no gather, so it gets
+//the scalar one
+ColorKernel getColorKernel(KernelType type);
+
+//returns true if this cpu (and build) can run the given kernel
+bool kernelSupported(KernelType type);
+
+//picks the fastest kernel this cpu supports, using cpuid
+KernelType detectKernel();
+
+//Converts between kernel types and their names ("scalar", "sse2", "avx2", "avx512").
+//parseKernel returns false if the name is unknown
+const char *kernelName(KernelType type);
+bool parseKernel(const std::string& name, KernelType& type);
+
+#endif
@@ -0,0 +1,271 @@
+#include "mandelbrotPerturbation.h"
+#include <cmath>
+
+//Constructor
+ReferenceOrbit::ReferenceOrbit() {
+    iterations = 0;
+    escaped = false;
+}
+
+//A pixel can step at most max_iter times from Z[1], so the orbit is kept up to
+//Z[max_iter + 1], or up to the first point outside the escape radius
+bool ReferenceOrbit::compute(const HighPrecision& cx, const HighPrecision& cy, int max_iter,
+        const std::atomic<bool> *cancel) {
+    x.clear();
+    y.clear();
+    x.push_back(0.0);
+    y.push_back(0.0);
+    iterations = max_iter;
+    escaped = false;
+
+    HighPrecision zx = cx;
+    HighPrecision zy = cy;
+    //each high precision iteration takes as long as hundreds of the kernels'
+    //ones, so cancel is checked every 16 of them
+    for (int i = 1; i <= max_iter + 1; i++) {
+        if (i % 16 == 0 && cancel != NULL && cancel->load(std::memory_order_relaxed)) {
+            x.clear();
+            y.clear();
+            series.clear();
+            iterations = 0;
+            return false;
+        }
+        double dx = zx.toDouble();
+        double dy = zy.toDouble();
+        x.push_back(dx);
+        y.push_back(dy);
+        if (dx*dx + dy*dy > 4.0) {
+            escaped = true;
+            break;
+        }
+
+        HighPrecision xy = zx * zy;
+        HighPrecision next = zx * zx - zy * zy + cx;
+        zy = xy + xy + cy;
+        zx = next;
+    }
+
+    //the series coefficients only need doubles. dz = dc at Z[1], so A starts at
+    //1, and they stop where they get too big for a double
+    series.clear();
+    SeriesTerm term = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    series.push_back(term);
+    term.ax = 1.0;
+    series.push_back(term);
+    for (int m = 1; m + 1 < (int) x.size(); m++) {
+        const SeriesTerm& t = series[m];
+        double zx2 = 2.0 * x[m];
+        double zy2 = 2.0 * y[m];
+        SeriesTerm next;
+        next.ax = zx2*t.ax - zy2*t.ay + 1.0;
+        next.ay = zx2*t.ay + zy2*t.ax;
+        next.bx = zx2*t.bx - zy2*t.by + t.ax*t.ax - t.ay*t.ay;
+        next.by = zx2*t.by + zy2*t.bx + 2.0*t.ax*t.ay;
+        next.cx = zx2*t.cx - zy2*t.cy + 2.0*(t.ax*t.bx - t.ay*t.by);
+        next.cy = zx2*t.cy + zy2*t.cx + 2.0*(t.ax*t.by + t.ay*t.bx);
+        if (!std::isfinite(next.cx) || !std::isfinite(next.cy)) break;
+        series.push_back(next);
+    }
+    return true;
+}
+
+//evaluates the series at offset (dcx, dcy)
+static void evalSeries(const ReferenceOrbit::SeriesTerm& t, double dcx, double dcy,
+        double& dzx, double& dzy) {
+    //Horner's rule: dc(A + dc(B + dc C))
+    double x = t.bx + dcx*t.cx - dcy*t.cy;
+    double y = t.by + dcx*t.cy + dcy*t.cx;
+    double next = t.ax + dcx*x - dcy*y;
+    y = t.ay + dcx*y + dcy*x;
+    x = next;
+    dzx = dcx*x - dcy*y;
+    dzy = dcx*y + dcy*x;
+}
+
+//iterates each probe normally next to the series. A probe also stops the skip
+//where it escapes or would be rebased, since the skipped iterations can't do
+//either of those
+int seriesSkip(const ReferenceOrbit& orbit, const double *probe_x, const double *probe_y,
+        int probes, int max_iter, double spacing) {
+    const double *ref_x = orbit.getX();
+    const double *ref_y = orbit.getY();
+    const ReferenceOrbit::SeriesTerm *series = orbit.getSeries();
+    double tolerance = 1e-6 * spacing;
+
+    //the furthest point along the orbit a pixel could start from
+    int limit = orbit.getSeriesLength() - 1;
+    if (limit > orbit.getLength() - 1) limit = orbit.getLength() - 1;
+    if (limit > max_iter + 1) limit = max_iter + 1;
+
+    for (int p = 0; p < probes && limit > 1; p++) {
+        double dcx = probe_x[p];
+        double dcy = probe_y[p];
+        double dzx = dcx;
+        double dzy = dcy;
+        int m = 1;
+        while (m < limit) {
+            double tx = 2.0*ref_x[m] + dzx;
+            double ty = 2.0*ref_y[m] + dzy;
+            double next = tx*dzx - ty*dzy + dcx;
+            dzy = tx*dzy + ty*dzx + dcy;
+            dzx = next;
+
+            double x = ref_x[m+1] + dzx;
+            double y = ref_y[m+1] + dzy;
+            double mag = x*x + y*y;
+            if (mag > 4.0 || mag < dzx*dzx + dzy*dzy) break;
+
+            const ReferenceOrbit::SeriesTerm& t = series[m+1];
+            double sx, sy;
+            evalSeries(t, dcx, dcy, sx, sy);
+            double error = (sx - dzx)*(sx - dzx) + (sy - dzy)*(sy - dzy);
+            if (error > tolerance*tolerance * (t.ax*t.ax + t.ay*t.ay)) break;
+            m++;
+        }
+        limit = m;
+    }
+    return limit - 1;
+}
+
+//iterates each pixel's difference from the reference. m is the pixel's position
+//along the reference orbit, which goes back to 0 when it is rebased, and n is
+//the number of iterations it has done. The cycle check saves z as its point on
+//the reference orbit and its dz. The reference's points are rounded to
+//doubles, so two of them are only close enough for the tolerance when they are
+//the same double, which they are once the reference has settled into a cycle
+//of its own. Then the difference is just that of the dz, which is as precise as
+//the dz are, so that is the only time it is taken. The cardioid and bulb test
+//is on c in doubles, which can only be wrong for points within about 1e-16 of
+//their edge, and those take far longer than any max_iter to escape
+void escapePerturbation(const ReferenceOrbit& orbit, const EscapeBatch& batch, int max_iter,
+        int skip, double spacing, KernelStats& stats) {
+    const double *ref_x = orbit.getX();
+    const double *ref_y = orbit.getY();
+    int last = orbit.getLength() - 1;
+    double tolerance = cycleTolerance(spacing);
+
+    for (int i = 0; i < batch.count; i++) {
+        double dcx = batch.cx[i];
+        double dcy = batch.cy[i];
+        if (last >= 1 && inCardioidOrBulb(ref_x[1] + dcx, ref_y[1] + dcy)) {
+            batch.zx[i] = ref_x[1] + dcx;
+            batch.zy[i] = ref_y[1] + dcy;
+            batch.iters[i] = max_iter;
+            stats.interior++;
+            continue;
+        }
+
+        double dzx = dcx;
+        double dzy = dcy;
+        if (skip > 0) evalSeries(orbit.getSeries()[skip + 1], dcx, dcy, dzx, dzy);
+        int m = skip + 1;
+        int n = skip;
+        double x = ref_x[m] + dzx;
+        double y = ref_y[m] + dzy;
+        double saved_x = ref_x[m];
+        double saved_y = ref_y[m];
+        double saved_dzx = dzx;
+        double saved_dzy = dzy;
+        long long save = (long long) firstSave(n);
+        bool cycle = false;
+
+        while (n < max_iter) {
+            if (((n - skip) & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+            //the reference escaped before this pixel did
+            if (m >= last) {
+                dzx = x;
+                dzy = y;
+                m = 0;
+                stats.rebases++;
+            }
+
+            double tx = 2.0*ref_x[m] + dzx;
+            double ty = 2.0*ref_y[m] + dzy;
+            double next = tx*dzx - ty*dzy + dcx;
+            dzy = tx*dzy + ty*dzx + dcy;
+            dzx = next;
+            m++;
+            n++;
+
+            x = ref_x[m] + dzx;
+            y = ref_y[m] + dzy;
+            double mag = x*x + y*y;
+            if (mag > 4.0) break;
+
+            //z is closer to 0 than dz is, so dz can't be trusted anymore
+            if (mag < dzx*dzx + dzy*dzy) {
+                dzx = x;
+                dzy = y;
+                m = 0;
+                stats.rebases++;
+            }
+
+            if (ref_x[m] == saved_x && ref_y[m] == saved_y) {
+                double dx = dzx - saved_dzx;
+                double dy = dzy - saved_dzy;
+                if (dx*dx + dy*dy < tolerance) {
+                    cycle = true;
+                    break;
+                }
+            }
+            if (n == save) {
+                saved_x = ref_x[m];
+                saved_y = ref_y[m];
+                saved_dzx = dzx;
+                saved_dzy = dzy;
+                save *= 2;
+            }
+        }
+
+        if (cycle && n < max_iter) stats.periodic++;
+        batch.zx[i] = x;
+        batch.zy[i] = y;
+        batch.iters[i] = cycle ? max_iter : n;
+        stats.iterations += n - skip;
+        stats.lane_slots += n - skip;
+        stats.skipped += skip;
+    }
+}
+
+//Constructor
+PerturbationKernel::PerturbationKernel() {
+    limbs = 0;
+    spacing = 0.0;
+    series_approximation = true;
+    cancel = NULL;
+}
+
+//iterates a new reference orbit at the center if the old one won't do. An
+//orbit that escaped before max_iter doesn't get any longer with a higher
+//max_iter, so it can be kept
+void PerturbationKernel::prepare(const HighPrecision& cx, const HighPrecision& cy,
+        double pixel_spacing, int max_iter) {
+    spacing = pixel_spacing;
+    int needed = HighPrecision::limbsFor(spacing);
+    bool too_short = !orbit.hasEscaped() && orbit.getIterations() < max_iter;
+    if (limbs > 0 && needed <= limbs && !too_short && cx == center_x && cy == center_y) return;
+
+    center_x = cx;
+    center_y = cy;
+    limbs = needed;
+    if (!orbit.compute(cx.withLimbs(limbs), cy.withLimbs(limbs), max_iter, cancel)) limbs = 0;
+}
+
+//the probes are the corners and middle of the batch's bounding box
+void PerturbationKernel::escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const {
+    int skip = 0;
+    if (series_approximation && batch.count > 0) {
+        double left = batch.cx[0], right = batch.cx[0];
+        double top = batch.cy[0], bottom = batch.cy[0];
+        for (int i = 1; i < batch.count; i++) {
+            if (batch.cx[i] < left) left = batch.cx[i];
+            if (batch.cx[i] > right) right = batch.cx[i];
+            if (batch.cy[i] < top) top = batch.cy[i];
+            if (batch.cy[i] > bottom) bottom = batch.cy[i];
+        }
+        double probe_x[5] = {left, right, left, right, (left + right) / 2.0};
+        double probe_y[5] = {top, top, bottom, bottom, (top + bottom) / 2.0};
+        skip = seriesSkip(orbit, probe_x, probe_y, 5, max_iter, spacing);
+    }
+    escapePerturbation(orbit, batch, max_iter, skip, spacing, stats);
+}
@@ -0,0 +1,122 @@
+#ifndef MANDELBROTPERTURBATION_H
+#define MANDELBROTPERTURBATION_H
+
+#include <atomic>
+#include <vector>
+#include "mandelbrotHighPrecision.h"
+#include "mandelbrotKernels.h"
+#include "mandelbrotPrecision.h"
+
+//Past a relative pixel spacing of about 1e-12, neighbouring pixels are only a
+//few thousand doubles apart and the plain kernels can't tell them apart
+//anymore. Double-double gets further but costs the same at every depth, so
+//past 1e-15 the engine switches to perturbation (see PrecisionTier). It gets
+//around this by iterating one reference point C in high precision, and every
+//pixel c = C + dc as a small difference dz from the reference orbit Z, which
+//doubles can hold at any zoom (down to the exponent range, about 1e-290):
+//
+//  z = Z + dz,  dz' = (2Z + dz)dz + dc
+//
+//When a pixel's orbit gets closer to 0 than its difference from the reference,
+//dz has lost the precision the pixel needs (that is what shows up as a "glitch").
+//Then the pixel is rebased: dz becomes the whole z and it carries on from the
+//start of the reference orbit, where Z = 0, which is the same as starting a new
+//reference. The same happens when a pixel outlives the reference orbit.
+//
+//At deep zooms all the pixels near the reference follow it almost exactly for
+//thousands of iterations, so dz is nearly a polynomial in dc. Series
+//approximation keeps the first three coefficients along with the orbit:
+//
+//  dz = A dc + B dc^2 + C dc^3
+//  A' = 2ZA + 1,  B' = 2ZB + A^2,  C' = 2ZC + 2AB
+//
+//and a whole tile can then skip to the last iteration where the polynomial still
+//matches real iteration at a few probe points.
+
+//ReferenceOrbit is the orbit of the reference point, iterated in high precision
+//and rounded to doubles. Z[0] is 0 and Z[1] is C
+class ReferenceOrbit {
+    public:
+        ReferenceOrbit();
+
+        //iterates C until it escapes or max_iter is reached. If cancel is set
+        //and becomes true, it stops with an empty orbit and returns false
+        bool compute(const HighPrecision& cx, const HighPrecision& cy, int max_iter,
+                const std::atomic<bool> *cancel = NULL);
+
+        //the coefficients of the series for dz at each point of the orbit
+        struct SeriesTerm {
+            double ax, ay;
+            double bx, by;
+            double cx, cy;
+        };
+
+        //Accesor functions:
+        int getLength() const {return (int) x.size();}
+        int getSeriesLength() const {return (int) series.size();}
+        const SeriesTerm *getSeries() const {return &series[0];}
+        int getIterations() const {return iterations;}
+        bool hasEscaped() const {return escaped;}
+        const double *getX() const {return &x[0];}
+        const double *getY() const {return &y[0];}
+
+    private:
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<SeriesTerm> series;
+        int iterations;
+        bool escaped;
+};
+
+//seriesSkip returns how many iterations the series can skip for a group of
+//pixels, by iterating the probe offsets (the corners of a tile, say) and checking
+//the series against them. The series is trusted while its error is below a
+//millionth of the pixel spacing, measured at the offset: the error in dz
+//divided by the derivative A. Deep views are chaotic enough that a looser
+//tolerance visibly changes the escape times of some pixels
+int seriesSkip(const ReferenceOrbit& orbit, const double *probe_x, const double *probe_y,
+        int probes, int max_iter, double spacing);
+
+//escapePerturbation iterates a batch of pixels against the reference orbit. The
+//batch's cx and cy are the offsets dc from the reference point, and the pixels
+//always start from z = c, so zx, zy and iters are only written. The escape
+//times follow the same definition as the other kernels. The first skip
+//iterations come from the series instead (0 starts at z = c). Each rebase is
+//counted in stats.rebases, and each skipped iteration in stats.skipped. Points
+//in the cardioid or bulb, or caught in a cycle (see cycleTolerance, with the
+//pixels spacing apart), get max_iter like in the other tiers
+void escapePerturbation(const ReferenceOrbit& orbit, const EscapeBatch& batch, int max_iter,
+        int skip, double spacing, KernelStats& stats);
+
+//PerturbationKernel is the deepest precision tier. It keeps the reference orbit
+//at the center of the view until the center moves, or the zoom or max_iter
+//need a more precise or longer one. Each batch is one tile, and the corners and
+//middle of the batch are the probes for series approximation
+class PerturbationKernel : public PrecisionKernel {
+    public:
+        PerturbationKernel();
+
+        const ReferenceOrbit& getOrbit() const {return orbit;}
+        bool getSeriesApproximation() const {return series_approximation;}
+        void setSeriesApproximation(bool enable) {series_approximation = enable;}
+
+        //the flag that stops prepare() iterating a new orbit, for a render
+        //that was cancelled. The next prepare() starts the orbit over
+        void setCancel(const std::atomic<bool> *flag) {cancel = flag;}
+
+        bool usesOffsets() const {return true;}
+        bool canResume() const {return false;}
+        void prepare(const HighPrecision& cx, const HighPrecision& cy, double spacing, int max_iter);
+        void escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const;
+
+    private:
+        ReferenceOrbit orbit;
+        HighPrecision center_x;
+        HighPrecision center_y;
+        int limbs;
+        double spacing;
+        bool series_approximation;
+        const std::atomic<bool> *cancel;
+};
+
+#endif
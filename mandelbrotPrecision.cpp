@@ -0,0 +1,573 @@
+#include "mandelbrotPrecision.h"
+
+#ifdef USE_SIMD_ALGORITHM
+#include <immintrin.h>
+#endif
+
+//splits a high precision number into count doubles that add up to it, each one
+//holding the rounding error of the ones before
+static void splitDoubles(const HighPrecision& value, double *parts, int count) {
+    HighPrecision rest = value;
+    for (int i = 0; i < count; i++) {
+        parts[i] = rest.toDouble();
+        rest = rest - HighPrecision(parts[i], rest.getLimbs());
+    }
+}
+
+//Double-double arithmetic, using the error-free transformations from Dekker and
+//Knuth. They depend on every operation being rounded on its own, which is why
+//the build turns off fused multiply-adds
+struct DoubleDouble {
+    double hi;
+    double lo;
+};
+
+//a + b exactly, when |a| >= |b|
+static inline DoubleDouble quickTwoSum(double a, double b) {
+    DoubleDouble r;
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+    return r;
+}
+
+//a + b exactly
+static inline DoubleDouble twoSum(double a, double b) {
+    DoubleDouble r;
+    r.hi = a + b;
+    double v = r.hi - a;
+    r.lo = (a - (r.hi - v)) + (b - v);
+    return r;
+}
+
+//a * b exactly, by splitting both into 26 bit halves
+static inline DoubleDouble twoProduct(double a, double b) {
+    const double split = 134217729.0;
+    double t = split * a;
+    double a_hi = t - (t - a);
+    double a_lo = a - a_hi;
+    t = split * b;
+    double b_hi = t - (t - b);
+    double b_lo = b - b_hi;
+
+    DoubleDouble r;
+    r.hi = a * b;
+    r.lo = ((a_hi * b_hi - r.hi) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+    return r;
+}
+
+static inline DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    DoubleDouble t = twoSum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quickTwoSum(s.hi, s.lo);
+    s.lo += t.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+static inline DoubleDouble ddSub(DoubleDouble a, DoubleDouble b) {
+    b.hi = -b.hi;
+    b.lo = -b.lo;
+    return ddAdd(a, b);
+}
+
+static inline DoubleDouble ddMul(DoubleDouble a, DoubleDouble b) {
+    DoubleDouble p = twoProduct(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+//the difference of two double-doubles that are close together. The difference
+//of the high parts is exact then, so only the low parts need adding
+static inline double ddDistance(DoubleDouble a, DoubleDouble b) {
+    return (a.hi - b.hi) + (a.lo - b.lo);
+}
+
+//the same loop as escape(), on double-doubles. Only the escape test uses just
+//the high parts, since it doesn't need to be exact, and so does the cardioid
+//and bulb test: it can only be wrong for points within about 1e-16 of their
+//edge, which take far longer than any max_iter to escape. center is the real
+//part's high and low doubles, then the imaginary part's
+static void escapeDoubleDouble(const double *center, const EscapeBatch& batch, int max_iter,
+        double tolerance, KernelStats& stats) {
+    DoubleDouble center_re = {center[0], center[1]};
+    DoubleDouble center_im = {center[2], center[3]};
+    long long total = 0;
+
+    for (int i = 0; i < batch.count; i++) {
+        DoubleDouble offset_re = {batch.cx[i], 0.0};
+        DoubleDouble offset_im = {batch.cy[i], 0.0};
+        DoubleDouble x0 = ddAdd(center_re, offset_re);
+        DoubleDouble y0 = ddAdd(center_im, offset_im);
+        if (inCardioidOrBulb(x0.hi, y0.hi)) {
+            batch.iters[i] = max_iter;
+            batch.zx[i] = x0.hi;
+            batch.zy[i] = y0.hi;
+            stats.interior++;
+            continue;
+        }
+
+        DoubleDouble x = x0;
+        DoubleDouble y = y0;
+        DoubleDouble x2 = ddMul(x, x);
+        DoubleDouble y2 = ddMul(y, y);
+        DoubleDouble saved_x = x;
+        DoubleDouble saved_y = y;
+        double save = firstSave(0);
+        bool cycle = false;
+        int iter = 0;
+        while (iter < max_iter) {
+            if ((iter & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+            DoubleDouble xy = ddMul(x, y);
+            y = ddAdd(ddAdd(xy, xy), y0);
+            x = ddAdd(ddSub(x2, y2), x0);
+            x2 = ddMul(x, x);
+            y2 = ddMul(y, y);
+            ++iter;
+            if (x2.hi + y2.hi > 4.0) break;
+
+            double dx = ddDistance(x, saved_x);
+            double dy = ddDistance(y, saved_y);
+            if (dx*dx + dy*dy < tolerance) {
+                cycle = true;
+                break;
+            }
+            if (iter == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+        if (cycle && iter < max_iter) stats.periodic++;
+        batch.iters[i] = cycle ? max_iter : iter;
+        batch.zx[i] = x.hi;
+        batch.zy[i] = y.hi;
+        total += iter;
+    }
+    stats.iterations += total;
+    stats.lane_slots += total;
+}
+
+#ifdef USE_SIMD_ALGORITHM
+//The vector double-double kernels work like the pairwise double kernels: a group
+//of points is iterated until all of them have finished, with the finished lanes
+//frozen, and points in the cardioid or bulb start out finished. Every lane
+//starts at iteration 0, so they all save z for the cycle check at the same
+//steps. A fused multiply-subtract gives the rounding error of a product
+//directly, which makes the products much cheaper than splitting.
+
+struct DoubleDouble4 {
+    __m256d hi;
+    __m256d lo;
+};
+
+__attribute__ ((target ("avx2,fma")))
+static inline DoubleDouble4 ddAdd4(DoubleDouble4 a, DoubleDouble4 b) {
+    __m256d s = _mm256_add_pd(a.hi, b.hi);
+    __m256d v = _mm256_sub_pd(s, a.hi);
+    __m256d e = _mm256_add_pd(_mm256_sub_pd(a.hi, _mm256_sub_pd(s, v)), _mm256_sub_pd(b.hi, v));
+    __m256d t = _mm256_add_pd(a.lo, b.lo);
+    v = _mm256_sub_pd(t, a.lo);
+    __m256d f = _mm256_add_pd(_mm256_sub_pd(a.lo, _mm256_sub_pd(t, v)), _mm256_sub_pd(b.lo, v));
+    e = _mm256_add_pd(e, t);
+    __m256d hi = _mm256_add_pd(s, e);
+    e = _mm256_add_pd(_mm256_sub_pd(e, _mm256_sub_pd(hi, s)), f);
+    DoubleDouble4 r;
+    r.hi = _mm256_add_pd(hi, e);
+    r.lo = _mm256_sub_pd(e, _mm256_sub_pd(r.hi, hi));
+    return r;
+}
+
+__attribute__ ((target ("avx2,fma")))
+static inline DoubleDouble4 ddSub4(DoubleDouble4 a, DoubleDouble4 b) {
+    const __m256d zero = _mm256_setzero_pd();
+    b.hi = _mm256_sub_pd(zero, b.hi);
+    b.lo = _mm256_sub_pd(zero, b.lo);
+    return ddAdd4(a, b);
+}
+
+__attribute__ ((target ("avx2,fma")))
+static inline DoubleDouble4 ddMul4(DoubleDouble4 a, DoubleDouble4 b) {
+    __m256d p = _mm256_mul_pd(a.hi, b.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, b.hi, p);
+    e = _mm256_add_pd(e, _mm256_add_pd(_mm256_mul_pd(a.hi, b.lo), _mm256_mul_pd(a.lo, b.hi)));
+    DoubleDouble4 r;
+    r.hi = _mm256_add_pd(p, e);
+    r.lo = _mm256_sub_pd(e, _mm256_sub_pd(r.hi, p));
+    return r;
+}
+
+//the AVX2 double-double kernel does four points at a time
+__attribute__ ((target ("avx2,fma")))
+static void escapeDoubleDoubleAVX2(const double *center, const EscapeBatch& batch, int max_iter,
+        double cycle_tolerance, KernelStats& stats) {
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d limit = _mm256_set1_pd(max_iter);
+    const __m256d tolerance = _mm256_set1_pd(cycle_tolerance);
+    DoubleDouble4 center_re = {_mm256_set1_pd(center[0]), _mm256_set1_pd(center[1])};
+    DoubleDouble4 center_im = {_mm256_set1_pd(center[2]), _mm256_set1_pd(center[3])};
+
+    for (int i = 0; i < batch.count; i += 4) {
+        if (isCancelled(batch)) return;
+        double lane[4][4];
+        for (int k = 0; k < 4; k++) {
+            int j = (i+k < batch.count) ? i+k : batch.count-1;
+            lane[0][k] = batch.cx[j];
+            lane[1][k] = batch.cy[j];
+        }
+
+        DoubleDouble4 offset_re = {_mm256_loadu_pd(lane[0]), _mm256_setzero_pd()};
+        DoubleDouble4 offset_im = {_mm256_loadu_pd(lane[1]), _mm256_setzero_pd()};
+        DoubleDouble4 x0 = ddAdd4(center_re, offset_re);
+        DoubleDouble4 y0 = ddAdd4(center_im, offset_im);
+        _mm256_storeu_pd(lane[0], x0.hi);
+        _mm256_storeu_pd(lane[1], y0.hi);
+        int interior = 0;
+        for (int k = 0; k < 4; k++) {
+            lane[2][k] = 0.0;
+            if (inCardioidOrBulb(lane[0][k], lane[1][k])) {
+                lane[2][k] = max_iter;
+                interior |= 1 << k;
+            }
+        }
+
+        DoubleDouble4 x = x0;
+        DoubleDouble4 y = y0;
+        DoubleDouble4 x2 = ddMul4(x, x);
+        DoubleDouble4 y2 = ddMul4(y, y);
+        DoubleDouble4 saved_x = x;
+        DoubleDouble4 saved_y = y;
+        double save = firstSave(0);
+        __m256d n = _mm256_loadu_pd(lane[2]);
+        __m256d active = _mm256_cmp_pd(n, limit, _CMP_LT_OQ);
+        __m256d cycle = _mm256_setzero_pd();
+
+        long long steps = 0;
+        while (_mm256_movemask_pd(active) != 0) {
+            DoubleDouble4 xy = ddMul4(x, y);
+            DoubleDouble4 next_y = ddAdd4(ddAdd4(xy, xy), y0);
+            DoubleDouble4 next_x = ddAdd4(ddSub4(x2, y2), x0);
+            x.hi = _mm256_blendv_pd(x.hi, next_x.hi, active);
+            x.lo = _mm256_blendv_pd(x.lo, next_x.lo, active);
+            y.hi = _mm256_blendv_pd(y.hi, next_y.hi, active);
+            y.lo = _mm256_blendv_pd(y.lo, next_y.lo, active);
+            x2 = ddMul4(x, x);
+            y2 = ddMul4(y, y);
+            n = _mm256_add_pd(n, _mm256_and_pd(active, one));
+            steps++;
+            if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+            __m256d escaped = _mm256_cmp_pd(_mm256_add_pd(x2.hi, y2.hi), four, _CMP_GT_OQ);
+            active = _mm256_andnot_pd(escaped, _mm256_and_pd(active, _mm256_cmp_pd(n, limit, _CMP_LT_OQ)));
+
+            //freeze the lanes whose orbit came back to the saved z
+            __m256d dx = _mm256_add_pd(_mm256_sub_pd(x.hi, saved_x.hi), _mm256_sub_pd(x.lo, saved_x.lo));
+            __m256d dy = _mm256_add_pd(_mm256_sub_pd(y.hi, saved_y.hi), _mm256_sub_pd(y.lo, saved_y.lo));
+            __m256d dist = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            __m256d same = _mm256_and_pd(active, _mm256_cmp_pd(dist, tolerance, _CMP_LT_OQ));
+            cycle = _mm256_or_pd(cycle, same);
+            active = _mm256_andnot_pd(same, active);
+
+            if (steps == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+
+        _mm256_storeu_pd(lane[0], x.hi);
+        _mm256_storeu_pd(lane[1], y.hi);
+        _mm256_storeu_pd(lane[2], n);
+        int periodic = _mm256_movemask_pd(cycle);
+        for (int k = 0; k < 4 && i+k < batch.count; k++) {
+            batch.zx[i+k] = lane[0][k];
+            batch.zy[i+k] = lane[1][k];
+            batch.iters[i+k] = (periodic & (1 << k)) ? max_iter : (int) lane[2][k];
+            if (!((interior >> k) & 1)) stats.iterations += (long long) lane[2][k];
+            stats.interior += (interior >> k) & 1;
+            stats.periodic += (periodic >> k) & 1;
+        }
+        stats.lane_slots += 4 * steps;
+    }
+}
+
+struct DoubleDouble8 {
+    __m512d hi;
+    __m512d lo;
+};
+
+__attribute__ ((target ("avx512f")))
+static inline DoubleDouble8 ddAdd8(DoubleDouble8 a, DoubleDouble8 b) {
+    __m512d s = _mm512_add_pd(a.hi, b.hi);
+    __m512d v = _mm512_sub_pd(s, a.hi);
+    __m512d e = _mm512_add_pd(_mm512_sub_pd(a.hi, _mm512_sub_pd(s, v)), _mm512_sub_pd(b.hi, v));
+    __m512d t = _mm512_add_pd(a.lo, b.lo);
+    v = _mm512_sub_pd(t, a.lo);
+    __m512d f = _mm512_add_pd(_mm512_sub_pd(a.lo, _mm512_sub_pd(t, v)), _mm512_sub_pd(b.lo, v));
+    e = _mm512_add_pd(e, t);
+    __m512d hi = _mm512_add_pd(s, e);
+    e = _mm512_add_pd(_mm512_sub_pd(e, _mm512_sub_pd(hi, s)), f);
+    DoubleDouble8 r;
+    r.hi = _mm512_add_pd(hi, e);
+    r.lo = _mm512_sub_pd(e, _mm512_sub_pd(r.hi, hi));
+    return r;
+}
+
+__attribute__ ((target ("avx512f")))
+static inline DoubleDouble8 ddSub8(DoubleDouble8 a, DoubleDouble8 b) {
+    const __m512d zero = _mm512_setzero_pd();
+    b.hi = _mm512_sub_pd(zero, b.hi);
+    b.lo = _mm512_sub_pd(zero, b.lo);
+    return ddAdd8(a, b);
+}
+
+__attribute__ ((target ("avx512f")))
+static inline DoubleDouble8 ddMul8(DoubleDouble8 a, DoubleDouble8 b) {
+    __m512d p = _mm512_mul_pd(a.hi, b.hi);
+    __m512d e = _mm512_fmsub_pd(a.hi, b.hi, p);
+    e = _mm512_add_pd(e, _mm512_add_pd(_mm512_mul_pd(a.hi, b.lo), _mm512_mul_pd(a.lo, b.hi)));
+    DoubleDouble8 r;
+    r.hi = _mm512_add_pd(p, e);
+    r.lo = _mm512_sub_pd(e, _mm512_sub_pd(r.hi, p));
+    return r;
+}
+
+//the AVX-512 double-double kernel does eight points at a time
+__attribute__ ((target ("avx512f")))
+static void escapeDoubleDoubleAVX512(const double *center, const EscapeBatch& batch, int max_iter,
+        double cycle_tolerance, KernelStats& stats) {
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d limit = _mm512_set1_pd(max_iter);
+    const __m512d tolerance = _mm512_set1_pd(cycle_tolerance);
+    DoubleDouble8 center_re = {_mm512_set1_pd(center[0]), _mm512_set1_pd(center[1])};
+    DoubleDouble8 center_im = {_mm512_set1_pd(center[2]), _mm512_set1_pd(center[3])};
+
+    for (int i = 0; i < batch.count; i += 8) {
+        if (isCancelled(batch)) return;
+        double lane[3][8];
+        for (int k = 0; k < 8; k++) {
+            int j = (i+k < batch.count) ? i+k : batch.count-1;
+            lane[0][k] = batch.cx[j];
+            lane[1][k] = batch.cy[j];
+        }
+
+        DoubleDouble8 offset_re = {_mm512_loadu_pd(lane[0]), _mm512_setzero_pd()};
+        DoubleDouble8 offset_im = {_mm512_loadu_pd(lane[1]), _mm512_setzero_pd()};
+        DoubleDouble8 x0 = ddAdd8(center_re, offset_re);
+        DoubleDouble8 y0 = ddAdd8(center_im, offset_im);
+        _mm512_storeu_pd(lane[0], x0.hi);
+        _mm512_storeu_pd(lane[1], y0.hi);
+        int interior = 0;
+        for (int k = 0; k < 8; k++) {
+            lane[2][k] = 0.0;
+            if (inCardioidOrBulb(lane[0][k], lane[1][k])) {
+                lane[2][k] = max_iter;
+                interior |= 1 << k;
+            }
+        }
+
+        DoubleDouble8 x = x0;
+        DoubleDouble8 y = y0;
+        DoubleDouble8 x2 = ddMul8(x, x);
+        DoubleDouble8 y2 = ddMul8(y, y);
+        DoubleDouble8 saved_x = x;
+        DoubleDouble8 saved_y = y;
+        double save = firstSave(0);
+        __m512d n = _mm512_loadu_pd(lane[2]);
+        __mmask8 active = _mm512_cmp_pd_mask(n, limit, _CMP_LT_OQ);
+        __mmask8 cycle = 0;
+
+        long long steps = 0;
+        while (active != 0) {
+            DoubleDouble8 xy = ddMul8(x, y);
+            DoubleDouble8 next_y = ddAdd8(ddAdd8(xy, xy), y0);
+            DoubleDouble8 next_x = ddAdd8(ddSub8(x2, y2), x0);
+            x.hi = _mm512_mask_mov_pd(x.hi, active, next_x.hi);
+            x.lo = _mm512_mask_mov_pd(x.lo, active, next_x.lo);
+            y.hi = _mm512_mask_mov_pd(y.hi, active, next_y.hi);
+            y.lo = _mm512_mask_mov_pd(y.lo, active, next_y.lo);
+            x2 = ddMul8(x, x);
+            y2 = ddMul8(y, y);
+            n = _mm512_mask_add_pd(n, active, n, one);
+            steps++;
+            if ((steps & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+
+            __mmask8 escaped = _mm512_cmp_pd_mask(_mm512_add_pd(x2.hi, y2.hi), four, _CMP_GT_OQ);
+            active &= ~escaped & _mm512_cmp_pd_mask(n, limit, _CMP_LT_OQ);
+
+            //freeze the lanes whose orbit came back to the saved z
+            __m512d dx = _mm512_add_pd(_mm512_sub_pd(x.hi, saved_x.hi), _mm512_sub_pd(x.lo, saved_x.lo));
+            __m512d dy = _mm512_add_pd(_mm512_sub_pd(y.hi, saved_y.hi), _mm512_sub_pd(y.lo, saved_y.lo));
+            __m512d dist = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+            __mmask8 same = active & _mm512_cmp_pd_mask(dist, tolerance, _CMP_LT_OQ);
+            cycle |= same;
+            active &= ~same;
+
+            if (steps == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+
+        _mm512_storeu_pd(lane[0], x.hi);
+        _mm512_storeu_pd(lane[1], y.hi);
+        _mm512_storeu_pd(lane[2], n);
+        for (int k = 0; k < 8 && i+k < batch.count; k++) {
+            batch.zx[i+k] = lane[0][k];
+            batch.zy[i+k] = lane[1][k];
+            batch.iters[i+k] = (cycle & (1 << k)) ? max_iter : (int) lane[2][k];
+            if (!((interior >> k) & 1)) stats.iterations += (long long) lane[2][k];
+            stats.interior += (interior >> k) & 1;
+            stats.periodic += (cycle >> k) & 1;
+        }
+        stats.lane_slots += 8 * steps;
+    }
+}
+#endif
+
+//Constructor
+DoubleDoubleKernel::DoubleDoubleKernel() {
+    center_x[0] = center_x[1] = 0.0;
+    center_y[0] = center_y[1] = 0.0;
+    tolerance = 0.0;
+    kernel_type = KERNEL_SCALAR;
+}
+
+void DoubleDoubleKernel::prepare(const HighPrecision& cx, const HighPrecision& cy, double spacing, int) {
+    splitDoubles(cx, center_x, 2);
+    splitDoubles(cy, center_y, 2);
+    tolerance = cycleTolerance(spacing);
+}
+
+//the AVX2 version also needs FMA, which every AVX2 cpu so far has
+void DoubleDoubleKernel::escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const {
+    double center[4] = {center_x[0], center_x[1], center_y[0], center_y[1]};
+#ifdef USE_SIMD_ALGORITHM
+    if (kernel_type == KERNEL_AVX512) {
+        escapeDoubleDoubleAVX512(center, batch, max_iter, tolerance, stats);
+        return;
+    }
+    if (kernel_type == KERNEL_AVX2 && __builtin_cpu_supports("fma")) {
+        escapeDoubleDoubleAVX2(center, batch, max_iter, tolerance, stats);
+        return;
+    }
+#endif
+    escapeDoubleDouble(center, batch, max_iter, tolerance, stats);
+}
+
+//Constructor
+QuadKernel::QuadKernel() {
+    for (int i = 0; i < 3; i++) {
+        center_x[i] = center_y[i] = 0.0;
+    }
+    tolerance = 0.0;
+}
+
+//three doubles are more than the 113 bits of a quad
+void QuadKernel::prepare(const HighPrecision& cx, const HighPrecision& cy, double spacing, int) {
+    splitDoubles(cx, center_x, 3);
+    splitDoubles(cy, center_y, 3);
+    tolerance = cycleTolerance(spacing);
+}
+
+//the same loop as escape(), in quads, with the cardioid and bulb test in doubles
+//like the double-double kernels
+void QuadKernel::escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const {
+#ifdef __SIZEOF_FLOAT128__
+    __float128 center_re = (__float128) center_x[0] + center_x[1] + center_x[2];
+    __float128 center_im = (__float128) center_y[0] + center_y[1] + center_y[2];
+    long long total = 0;
+
+    for (int i = 0; i < batch.count; i++) {
+        __float128 x0 = center_re + batch.cx[i];
+        __float128 y0 = center_im + batch.cy[i];
+        if (inCardioidOrBulb((double) x0, (double) y0)) {
+            batch.iters[i] = max_iter;
+            batch.zx[i] = (double) x0;
+            batch.zy[i] = (double) y0;
+            stats.interior++;
+            continue;
+        }
+
+        __float128 x = x0;
+        __float128 y = y0;
+        __float128 x2 = x*x;
+        __float128 y2 = y*y;
+        __float128 saved_x = x;
+        __float128 saved_y = y;
+        double save = firstSave(0);
+        bool cycle = false;
+        int iter = 0;
+        while (iter < max_iter) {
+            if ((iter & (cancel_interval - 1)) == 0 && isCancelled(batch)) return;
+            __float128 tmp = 2 * x * y + y0;
+            x = x2 - y2 + x0;
+            y = tmp;
+            y2 = tmp*tmp;
+            x2 = x*x;
+            ++iter;
+            if ((double) (x2+y2) > 4.0) break;
+
+            double dx = (double) (x - saved_x);
+            double dy = (double) (y - saved_y);
+            if (dx*dx + dy*dy < tolerance) {
+                cycle = true;
+                break;
+            }
+            if (iter == save) {
+                saved_x = x;
+                saved_y = y;
+                save *= 2.0;
+            }
+        }
+        if (cycle && iter < max_iter) stats.periodic++;
+        batch.iters[i] = cycle ? max_iter : iter;
+        batch.zx[i] = (double) x;
+        batch.zy[i] = (double) y;
+        total += iter;
+    }
+    stats.iterations += total;
+    stats.lane_slots += total;
+#else
+    (void) batch;
+    (void) max_iter;
+    (void) stats;
+#endif
+}
+
+//the cutoffs are explained with PrecisionTier
+PrecisionTier choosePrecision(double spacing, double scale, int max_iter) {
+    double relative = spacing / scale;
+    if (relative > 1e-4 && max_iter <= 256) return PRECISION_FLOAT;
+    if (relative > 1e-12) return PRECISION_DOUBLE;
+    if (relative > 1e-15) return PRECISION_DOUBLE_DOUBLE;
+    return PRECISION_PERTURBATION;
+}
+
+bool precisionSupported(PrecisionTier tier) {
+#ifndef __SIZEOF_FLOAT128__
+    if (tier == PRECISION_QUAD) return false;
+#endif
+    return tier >= 0 && tier < PRECISION_COUNT;
+}
+
+static const char *precision_names[PRECISION_COUNT] = {
+    "float", "double", "double-double", "quad", "perturbation", "auto"
+};
+
+const char *precisionName(PrecisionTier tier) {
+    if (tier < 0 || tier >= PRECISION_COUNT) return "unknown";
+    return precision_names[tier];
+}
+
+bool parsePrecision(const std::string& name, PrecisionTier& tier) {
+    for (int i = 0; i < PRECISION_COUNT; i++) {
+        if (name == precision_names[i]) {
+            tier = (PrecisionTier) i;
+            return true;
+        }
+    }
+    return false;
+}
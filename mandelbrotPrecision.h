@@ -0,0 +1,132 @@
+#ifndef MANDELBROTPRECISION_H
+#define MANDELBROTPRECISION_H
+
+#include <string>
+#include "mandelbrotHighPrecision.h"
+#include "mandelbrotKernels.h"
+
+//The precision tiers trade speed for how deep they can zoom. Each one is good
+//while the pixels are well over a thousand of its smallest steps apart:
+//
+//  float            relative pixel spacing down to ~1e-4, twice the vector lanes
+//  double           down to ~1e-12, the vector kernels
+//  double-double    down to ~1e-28, two doubles per number
+//  quad             down to ~1e-30, __float128, emulated so very slow
+//  perturbation     any depth, one high precision reference orbit
+//
+//PRECISION_AUTO picks float or double while they are precise enough for the
+//view (see choosePrecision). Past doubles it picks double-double down to a
+//relative spacing of 1e-15 and perturbation after that, though double-double
+//is precise far deeper: perturbation is faster per pixel, but it iterates a new
+//reference orbit every time the center moves, which costs more than a pan's
+//strip of pixels until the zoom is deep enough for series approximation to
+//make up for it. Quad is never picked, it is only there to compare against.
+enum PrecisionTier {
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE,
+    PRECISION_DOUBLE_DOUBLE,
+    PRECISION_QUAD,
+    PRECISION_PERTURBATION,
+    PRECISION_AUTO,
+    PRECISION_COUNT
+};
+
+//PrecisionKernel is the interface to the kernels of every tier. Before a render
+//the engine prepares the tier for the view, then the worker threads give it
+//batches of pixels (see EscapeBatch)
+class PrecisionKernel {
+    public:
+        virtual ~PrecisionKernel() {}
+
+        //true if the batches are offsets from the center of the view, because
+        //doubles can't hold the absolute coordinates precisely enough
+        virtual bool usesOffsets() const = 0;
+
+        //true if the batches can start from a saved z, like the double kernels
+        virtual bool canResume() const = 0;
+
+        //gets ready to render a view centered on (cx, cy), with pixels spacing
+        //apart. It is called before every render, so it should keep whatever
+        //it can from the last view
+        virtual void prepare(const HighPrecision& cx, const HighPrecision& cy,
+                double spacing, int max_iter) = 0;
+
+        //iterates a batch, this is called by several worker threads at once
+        virtual void escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const = 0;
+};
+
+//VectorKernel is the float and double tiers: it just runs one of the escape
+//kernels on absolute coordinates
+class VectorKernel : public PrecisionKernel {
+    public:
+        VectorKernel() {kernel = NULL; tolerance = 0.0;}
+        void setKernel(EscapeKernel k) {kernel = k;}
+
+        bool usesOffsets() const {return false;}
+        bool canResume() const {return true;}
+        void prepare(const HighPrecision&, const HighPrecision&, double spacing, int) {
+            tolerance = cycleTolerance(spacing);
+        }
+        void escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const {
+            kernel(batch, max_iter, tolerance, stats);
+        }
+
+    private:
+        EscapeKernel kernel;
+        double tolerance;
+};
+
+//DoubleDoubleKernel iterates with each number as an unevaluated sum of two
+//doubles, which gives 106 bits for a small constant factor in speed. The
+//AVX2 and AVX-512 versions use fused multiply-adds for the exact products
+class DoubleDoubleKernel : public PrecisionKernel {
+    public:
+        DoubleDoubleKernel();
+
+        //uses the vector version for the given kernel type, if there is one
+        void setKernel(KernelType type) {kernel_type = type;}
+
+        bool usesOffsets() const {return true;}
+        bool canResume() const {return false;}
+        void prepare(const HighPrecision& cx, const HighPrecision& cy, double spacing, int max_iter);
+        void escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const;
+
+    private:
+        double center_x[2];
+        double center_y[2];
+        double tolerance;
+        KernelType kernel_type;
+};
+
+//QuadKernel iterates in __float128, where the compiler has it
+class QuadKernel : public PrecisionKernel {
+    public:
+        QuadKernel();
+
+        bool usesOffsets() const {return true;}
+        bool canResume() const {return false;}
+        void prepare(const HighPrecision& cx, const HighPrecision& cy, double spacing, int max_iter);
+        void escape(const EscapeBatch& batch, int max_iter, KernelStats& stats) const;
+
+    private:
+        double center_x[3];
+        double center_y[3];
+        double tolerance;
+};
+
+//picks the tier for a view, from the spacing of the pixels relative to the
+//size of the coordinates: float down to 1e-4, double down to 1e-12,
+//double-double down to 1e-15 and perturbation past that. Float rounding errors
+//add up with every iteration, so the float tier is only picked for low max_iter
+PrecisionTier choosePrecision(double spacing, double scale, int max_iter);
+
+//returns true if this build can use the given tier
+bool precisionSupported(PrecisionTier tier);
+
+//Converts between tiers and their names ("float", "double", "double-double",
+//"quad", "perturbation", "auto"). parsePrecision returns false if the name is
+//unknown
+const char *precisionName(PrecisionTier tier);
+bool parsePrecision(const std::string& name, PrecisionTier& tier);
+
+#endif
@@ -0,0 +1,443 @@
+#include "mandelbrotEngine.h"
+#include "mandelbrotFarm.h"
+#include "mandelbrotStream.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//MandelRender renders a single view of the mandelbrot straight to a file,
+//without opening a window
+
+//prints how to call the program
+void usage(const char *name) {
+    std::cout << "Usage: " << name << " [options]" << std::endl;
+    std::cout << "  --center <x> <y>     center of the view (default -0.5 0)" << std::endl;
+    std::cout << "  --zoom <factor>      zoom relative to the starting view (default 1)" << std::endl;
+    std::cout << "  --iterations <n>     maximum number of iterations (default 100)" << std::endl;
+    std::cout << "  --size <w> <h>       size of the image in pixels (default 1024 1024)" << std::endl;
+    std::cout << "  --scheme <n>         color scheme (default 1)" << std::endl;
+    std::cout << "  --color <mult>       color multiple (default 1)" << std::endl;
+    std::cout << "  --recolor <mult>     after rendering, color it again with this multiple and time it" << std::endl;
+    std::cout << "  --kernel <name>      force a kernel: scalar, sse2, avx2 or avx512" << std::endl;
+    std::cout << "  --threads <n>        number of worker threads (default one per hardware thread)" << std::endl;
+    std::cout << "  --tile <size>        size of the tiles the workers generate (default 64)" << std::endl;
+    std::cout << "  --no-refill          use the pairwise vector kernels instead of refilling lanes" << std::endl;
+    std::cout << "  --precision <tier>   force a precision: float, double, double-double, quad," << std::endl;
+    std::cout << "                       perturbation or auto (default auto, picked from the zoom)" << std::endl;
+    std::cout << "  --no-series          don't skip iterations with series approximation" << std::endl;
+    std::cout << "  --subdivide          fill in rectangles with uniform borders (Mariani-Silver)" << std::endl;
+    std::cout << "  --supersample <n>    color the pixels on edges with the average of n x n samples" << std::endl;
+    std::cout << "  --jitter <amount>    how far to move the samples randomly, from 0 to 1 (default 0.5)" << std::endl;
+    std::cout << "  --edge <difference>  how far apart the colors of neighbors have to be for them" << std::endl;
+    std::cout << "                       to be supersampled, summed over r, g and b (default 24)" << std::endl;
+    std::cout << "  --progressive        render every 8th, 4th, 2nd pixel first, and time the passes" << std::endl;
+    std::cout << "  --pan <dx> <dy>      render, move the view by dx, dy pixels and render again" << std::endl;
+    std::cout << "  --zoom-steps <n>     render, then zoom in by 2 n times (out if n is negative)," << std::endl;
+    std::cout << "                       reusing the pixels that stay on the grid" << std::endl;
+    std::cout << "  --return             after the zoom steps, zoom back to where they started" << std::endl;
+    std::cout << "  --cache <MB>         keep the generated tiles in a cache of this size (default 0)" << std::endl;
+    std::cout << "  --store <file>       keep the generated tiles in a file, and use the ones already there" << std::endl;
+    std::cout << "  --store-tiles <n>    room for tiles when the store file is made (default 65536)" << std::endl;
+    std::cout << "  --profile            time the workers, coloring and copying, and print where the" << std::endl;
+    std::cout << "                       time went" << std::endl;
+    std::cout << "  --heatmap <file>     save the time spent on each tile as a heatmap (implies --profile)" << std::endl;
+    std::cout << "  --pixel-heatmap <file> save each pixel's escape time as a heatmap" << std::endl;
+    std::cout << "  --verify             also render every pixel again, and count the pixels that differ" << std::endl;
+    std::cout << "  --bands <rows>       render in bands of this many rows and stream them to the" << std::endl;
+    std::cout << "                       output (.png or .ppm), for images too big for memory" << std::endl;
+    std::cout << "  --farm <address>     hand the tiles out to MandelWorkers that join at this address," << std::endl;
+    std::cout << "                       unix:<path> or [host]:<port>" << std::endl;
+    std::cout << "  --farm-workers <n>   wait up to a minute for this many workers first (default 1)" << std::endl;
+    std::cout << "  --farm-timeout <s>   hand a tile to another worker too after this long (default 5)" << std::endl;
+    std::cout << "  --output <file>      file to save to (default is a timestamped png)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string center_x = "-0.5";
+    std::string center_y = "0";
+    double zoom = 1.0;
+    int iterations = 100;
+    int width = 1024;
+    int height = 1024;
+    int scheme = 1;
+    double color_multiple = 1.0;
+    double recolor = 0.0;
+    std::string output;
+    std::string kernel;
+    bool refill = true;
+    std::string precision = "auto";
+    bool series = true;
+    bool subdivide = false;
+    bool verify = false;
+    bool progressive = false;
+    bool profile = false;
+    std::string heatmap;
+    std::string pixel_heatmap;
+    int supersample = 1;
+    double jitter = 0.5;
+    int edge = 24;
+    int threads = 0;
+    int tile_size = 64;
+    int pan_x = 0;
+    int pan_y = 0;
+    int zoom_steps = 0;
+    bool zoom_return = false;
+    int cache_size = 0;
+    std::string store;
+    int store_tiles = 65536;
+    int bands = 0;
+    std::string farm;
+    int farm_workers = 1;
+    double farm_timeout = 5.0;
+
+    //parse the options, each one is followed by a fixed number of values
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        int values = 1;
+        if (arg == "--center" || arg == "--size" || arg == "--pan") values = 2;
+        if (arg == "--no-refill" || arg == "--no-series" || arg == "--subdivide" || arg == "--verify" ||
+            arg == "--progressive" || arg == "--return" || arg == "--profile") {
+            values = 0;
+        }
+        if (arg == "--help" || i + values >= argc) {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+
+        if (arg == "--center") {
+            center_x = argv[i+1];
+            center_y = argv[i+2];
+        } else if (arg == "--zoom") {
+            zoom = atof(argv[i+1]);
+        } else if (arg == "--iterations") {
+            iterations = atoi(argv[i+1]);
+        } else if (arg == "--size") {
+            width = atoi(argv[i+1]);
+            height = atoi(argv[i+2]);
+        } else if (arg == "--scheme") {
+            scheme = atoi(argv[i+1]);
+        } else if (arg == "--color") {
+            color_multiple = atof(argv[i+1]);
+        } else if (arg == "--recolor") {
+            recolor = atof(argv[i+1]);
+        } else if (arg == "--kernel") {
+            kernel = argv[i+1];
+        } else if (arg == "--threads") {
+            threads = atoi(argv[i+1]);
+        } else if (arg == "--tile") {
+            tile_size = atoi(argv[i+1]);
+        } else if (arg == "--no-refill") {
+            refill = false;
+        } else if (arg == "--precision") {
+            precision = argv[i+1];
+        } else if (arg == "--no-series") {
+            series = false;
+        } else if (arg == "--subdivide") {
+            subdivide = true;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--supersample") {
+            supersample = atoi(argv[i+1]);
+        } else if (arg == "--jitter") {
+            jitter = atof(argv[i+1]);
+        } else if (arg == "--edge") {
+            edge = atoi(argv[i+1]);
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--heatmap") {
+            heatmap = argv[i+1];
+            profile = true;
+        } else if (arg == "--pixel-heatmap") {
+            pixel_heatmap = argv[i+1];
+        } else if (arg == "--progressive") {
+            progressive = true;
+        } else if (arg == "--zoom-steps") {
+            zoom_steps = atoi(argv[i+1]);
+        } else if (arg == "--return") {
+            zoom_return = true;
+        } else if (arg == "--cache") {
+            cache_size = atoi(argv[i+1]);
+        } else if (arg == "--store") {
+            store = argv[i+1];
+        } else if (arg == "--store-tiles") {
+            store_tiles = atoi(argv[i+1]);
+        } else if (arg == "--pan") {
+            pan_x = atoi(argv[i+1]);
+            pan_y = atoi(argv[i+2]);
+        } else if (arg == "--bands") {
+            bands = atoi(argv[i+1]);
+        } else if (arg == "--farm") {
+            farm = argv[i+1];
+        } else if (arg == "--farm-workers") {
+            farm_workers = atoi(argv[i+1]);
+        } else if (arg == "--farm-timeout") {
+            farm_timeout = atof(argv[i+1]);
+        } else if (arg == "--output") {
+            output = argv[i+1];
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+        i += values;
+    }
+
+    if (width <= 0 || height <= 0 || iterations <= 0 || zoom <= 0 || tile_size <= 0) {
+        std::cerr << "Size, iterations, zoom and tile size must be positive" << std::endl;
+        return 1;
+    }
+
+    //set up the view, the zoom is relative to the starting area. The center is
+    //kept as text so that deep zooms don't lose any digits
+    //a streaming render's engine is only one band tall, with the same parity
+    //as the image so the bands line up with its pixels
+    if (bands > 0) {
+        if (pan_x != 0 || pan_y != 0 || zoom_steps != 0 || verify || recolor != 0.0 || !heatmap.empty() ||
+            !pixel_heatmap.empty() || progressive) {
+            std::cerr << "--bands can't be used with --pan, --zoom-steps, --verify, --recolor, the "
+                      << "heatmaps or --progressive" << std::endl;
+            return 1;
+        }
+        bands = std::min(bands, height);
+        if ((height - bands) % 2 != 0) bands++;
+    }
+    MandelbrotEngine brot(width, bands > 0 ? bands : height, threads);
+    brot.setTileSize(tile_size);
+    brot.resetMandelbrot();
+    brot.setIterations(iterations);
+    brot.setColorScheme(scheme);
+    brot.setColorMultiple(color_multiple);
+    brot.changePos(brot.getMandelbrotCenter(), zoom);
+    if (!brot.setCenter(center_x, center_y)) {
+        std::cerr << "Can't read the center " << center_x << " " << center_y << std::endl;
+        return 1;
+    }
+    brot.setSeriesApproximation(series);
+
+    PrecisionTier tier;
+    if (!parsePrecision(precision, tier)) {
+        std::cerr << "Unknown precision " << precision << std::endl;
+        return 1;
+    }
+    if (!brot.setPrecision(tier)) {
+        std::cerr << "This build can't use " << precision << " precision" << std::endl;
+        return 1;
+    }
+
+    if (!kernel.empty()) {
+        KernelType type;
+        if (!parseKernel(kernel, type)) {
+            std::cerr << "Unknown kernel " << kernel << std::endl;
+            return 1;
+        }
+        if (!brot.setKernel(type)) {
+            std::cerr << "This cpu can't run the " << kernel << " kernel" << std::endl;
+            return 1;
+        }
+    }
+    brot.setLaneRefill(refill);
+    std::cout << "Using " << precisionName(brot.getPrecision()) << " precision and the "
+              << kernelName(brot.getKernel()) << " kernel with " << brot.getThreads()
+              << " threads" << std::endl;
+
+    brot.setSubdivision(subdivide);
+    brot.setProgressive(progressive);
+    brot.setSupersampling(supersample, jitter, edge);
+    brot.setProfiling(profile);
+    sf::Clock pass_clock;
+    brot.setPassFunction([&pass_clock] (int step) {
+        std::cout << "Pass with a spacing of " << step << " pixels done at "
+                  << pass_clock.getElapsedTime().asSeconds() << "s" << std::endl;
+    });
+
+    brot.setCacheBudget((size_t) cache_size << 20);
+    if (!store.empty() && !brot.openStore(store, store_tiles > 0 ? store_tiles : 1)) {
+        std::cerr << "Can't open the tile store " << store << std::endl;
+        return 1;
+    }
+
+    //the workers can keep joining while it renders, it only waits for the
+    //first ones. Without any, the engine generates everything itself
+    FarmCoordinator coordinator;
+    if (!farm.empty()) {
+        std::string error;
+        if (!coordinator.listen(farm, error)) {
+            std::cerr << "Can't listen on " << farm << ": " << error << std::endl;
+            return 1;
+        }
+        coordinator.setTimeouts(farm_timeout, std::max(2.0 * farm_timeout, 10.0));
+        std::cout << "Waiting for " << farm_workers << " workers on " << farm << std::endl;
+        std::cout << coordinator.waitForWorkers(farm_workers, 60.0) << " workers joined" << std::endl;
+        brot.setTileFarm(&coordinator);
+    }
+
+    if (bands > 0) {
+        ImageWriter *writer = output.empty() ? NULL : createImageWriter(output);
+        if (writer == NULL) {
+            std::cerr << "Streaming needs an --output that ends in .ppm or .png" << std::endl;
+            return 1;
+        }
+        if (!writer->open(output, width, height)) {
+            std::cerr << "Could not open " << output << std::endl;
+            delete writer;
+            return 1;
+        }
+        StreamStats streamed;
+        bool ok = renderBands(brot, height, *writer, 2, [height] (int rows) {
+            std::cout << "\rRendered " << rows << " of " << height << " rows" << std::flush;
+        }, streamed);
+        std::cout << std::endl;
+        ok = writer->close() && ok;
+        delete writer;
+        if (!ok) {
+            std::cerr << "Could not write the image to " << output << std::endl;
+            return 1;
+        }
+        std::cout << "Rendered " << streamed.pixels << " pixels in " << streamed.bands << " bands in "
+                  << streamed.seconds << "s, " << streamed.iterations << " iterations" << std::endl;
+        std::cout << "Saved image to " << output << std::endl;
+        return 0;
+    }
+
+    //a pan renders the view it starts from first, and only times the second.
+    //Zoom steps print each frame they render before the last one
+    std::vector<bool> steps(std::abs(zoom_steps), zoom_steps > 0);
+    if (zoom_return) steps.insert(steps.end(), steps.size(), zoom_steps < 0);
+    if (pan_x != 0 || pan_y != 0 || !steps.empty()) {
+        brot.generate();
+        brot.panPixels(pan_x, pan_y);
+    }
+    for (size_t step = 0; step < steps.size(); step++) {
+        brot.zoomStep(steps[step]);
+        if (step + 1 == steps.size()) break;
+        brot.generate();
+        std::cout << "Frame " << step + 1 << ": " << brot.getStats().pixels << " pixels in "
+                  << brot.getStats().seconds << "s, reused "
+                  << 100.0 * brot.getStats().reused / ((double) width * height) << "%, cached "
+                  << 100.0 * brot.getStats().cached / ((double) width * height) << "%" << std::endl;
+    }
+    pass_clock.restart();
+    brot.generate();
+
+    const RenderStats& stats = brot.getStats();
+    //the pixels can all come from the cache, the store or the farm, and then
+    //nothing was iterated here
+    std::cout << "Rendered " << stats.pixels << " pixels in " << stats.seconds << "s, "
+              << stats.kernel.iterations << " iterations";
+    if (stats.kernel.lane_slots > 0) {
+        std::cout << ", lane utilization " << 100.0 * stats.kernel.iterations / stats.kernel.lane_slots << "%";
+    }
+    std::cout << std::endl;
+    if (subdivide) {
+        std::cout << "Subdivision filled in " << stats.filled << " pixels" << std::endl;
+    }
+    if (supersample > 1) {
+        std::cout << "Supersampled " << stats.edges << " edge pixels ("
+                  << 100.0 * stats.edges / ((double) width * height) << "%) with "
+                  << stats.samples << " extra samples" << std::endl;
+    }
+    if (stats.reused > 0) {
+        std::cout << "Reused " << stats.reused << " pixels ("
+                  << 100.0 * stats.reused / ((double) width * height)
+                  << "%) from the last render" << std::endl;
+    }
+    if (cache_size > 0) {
+        CacheStats cache = brot.getCacheStats();
+        std::cout << "Took " << stats.cached << " pixels from the cache, which had "
+                  << cache.hits << " hits, " << cache.misses << " misses and "
+                  << cache.evictions << " evictions, and holds " << cache.tiles << " tiles in "
+                  << cache.bytes / 1048576.0 << "MB" << std::endl;
+    }
+    if (!store.empty()) {
+        StoreStats stored = brot.getStoreStats();
+        std::cout << "Loaded " << stats.loaded << " pixels from the store, which had "
+                  << stored.hits << " hits, " << stored.misses << " misses, " << stored.damaged
+                  << " damaged tiles and " << stored.writes << " writes, and holds "
+                  << stored.tiles << " of " << stored.capacity << " tiles" << std::endl;
+    }
+    if (!farm.empty()) {
+        const FarmStats& farmed = coordinator.getStats();
+        std::cout << "The farm generated " << stats.remote << " pixels ("
+                  << 100.0 * stats.remote / ((double) width * height) << "%), "
+                  << farmed.tiles << " tiles in " << farmed.bytes / 1048576.0 << "MB, compressed from "
+                  << farmed.raw_bytes / 1048576.0 << "MB" << std::endl;
+        std::cout << farmed.joined << " workers joined and " << farmed.left << " left, "
+                  << farmed.reassigned << " tiles were reassigned and " << farmed.duplicated
+                  << " handed to a second worker" << std::endl;
+    }
+    std::cout << stats.kernel.interior << " pixels in the cardioid or bulb, "
+              << stats.kernel.periodic << " caught in a cycle" << std::endl;
+    if (brot.getPrecision() == PRECISION_PERTURBATION) {
+        const ReferenceOrbit& orbit = brot.getReferenceOrbit();
+        std::cout << "Reference orbit of " << orbit.getLength() - 1 << " iterations, "
+                  << stats.kernel.rebases << " rebases" << std::endl;
+        if (stats.pixels > 0) {
+            std::cout << "Series approximation skipped " << stats.kernel.skipped << " iterations ("
+                      << stats.kernel.skipped / stats.pixels << " per pixel), saving about "
+                      << stats.series_saved << "s" << std::endl;
+        }
+    }
+
+    if (recolor != 0.0) {
+        sf::Clock recolor_clock;
+        brot.setColorMultiple(recolor);
+        brot.changeColor();
+        std::cout << "Recolored " << (long long) width * height << " pixels in "
+                  << recolor_clock.getElapsedTime().asSeconds() << "s" << std::endl;
+    }
+
+    brot.printProfile(std::cout);
+    if (!heatmap.empty()) {
+        if (!brot.saveHeatmap(heatmap, false)) {
+            std::cerr << "Could not save the heatmap to " << heatmap << std::endl;
+            return 1;
+        }
+        std::cout << "Saved the tile heatmap to " << heatmap << std::endl;
+    }
+    if (!pixel_heatmap.empty()) {
+        if (!brot.saveHeatmap(pixel_heatmap, true)) {
+            std::cerr << "Could not save the heatmap to " << pixel_heatmap << std::endl;
+            return 1;
+        }
+        std::cout << "Saved the pixel heatmap to " << pixel_heatmap << std::endl;
+    }
+
+    //save the image and print confirmation
+    if (output.empty()) {
+        output = brot.saveImage();
+    } else if (!brot.saveImage(output)) {
+        std::cerr << "Could not save image to " << output << std::endl;
+        return 1;
+    }
+    std::cout << "Saved image to " << output << std::endl;
+
+    //to verify, keep the result and render every pixel of the same view again
+    if (verify) {
+        std::vector<int> result((size_t) width * height);
+        for (int row = 0; row < height; row++) {
+            brot.getIterationBuffer().getRow(0, row, width, &result[(size_t) row * width]);
+        }
+        brot.setSubdivision(false);
+        brot.setProgressive(false);
+        brot.setSupersampling(1, 0.0);
+        brot.setCacheBudget(0);
+        brot.closeStore();
+        brot.setTileFarm(NULL);
+        brot.generate();
+
+        long long differ = 0;
+        std::vector<int> row_iters(width);
+        for (int row = 0; row < height; row++) {
+            brot.getIterationBuffer().getRow(0, row, width, &row_iters[0]);
+            for (int column = 0; column < width; column++) {
+                if (row_iters[column] != result[(size_t) row * width + column]) differ++;
+            }
+        }
+        std::cout << differ << " pixels (" << 100.0 * differ / ((double) width * height)
+                  << "%) differ from rendering every pixel" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "mandelbrotScheduler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+//the seconds between two times
+static double secondsBetween(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+//packs a queue's range into one word
+static uint64_t packRange(uint32_t head, uint32_t tail) {
+    return ((uint64_t) head << 32) | tail;
+}
+
+//splits the image into tiles in scanline order
+std::vector<Tile> makeTiles(int width, int height, int size, int offset_x, int offset_y) {
+    std::vector<Tile> tiles;
+    for (int y = -offset_y; y < height; y += size) {
+        for (int x = -offset_x; x < width; x += size) {
+            Tile tile;
+            tile.x = x < 0 ? 0 : x;
+            tile.y = y < 0 ? 0 : y;
+            tile.width = ((x + size < width) ? x + size : width) - tile.x;
+            tile.height = ((y + size < height) ? y + size : height) - tile.y;
+            tiles.push_back(tile);
+        }
+    }
+    return tiles;
+}
+
+//Constructor: starts the workers, which wait for the first job
+TileScheduler::TileScheduler(int threads) : queues(threads > 0 ? threads :
+        (std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4)) {
+    tiles = NULL;
+    function = NULL;
+    generation = 0;
+    idle = 0;
+    stopping = false;
+    timing = false;
+    worker_stats.resize(queues.size());
+    resetWorkerStats();
+
+    for (size_t i = 0; i < queues.size(); i++) {
+        queues[i].range = 0;
+    }
+    for (size_t i = 0; i < queues.size(); i++) {
+        workers.push_back(std::thread(&TileScheduler::work, this, (int) i));
+    }
+
+    //wait for all the workers to be ready
+    std::unique_lock<std::mutex> lock(mutex);
+    finish.wait(lock, [this] {return idle == (int) queues.size();});
+}
+
+//stops and joins the workers
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+//deals out the tiles in contiguous blocks, so each worker starts on its own part
+//of the image, then waits for all of them to be done
+void TileScheduler::run(const std::vector<Tile>& job, const TileFunction& fn) {
+    if (job.empty()) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    tiles = &job;
+    function = &fn;
+    size_t count = queues.size();
+    for (size_t i = 0; i < count; i++) {
+        uint32_t head = (uint32_t) (job.size() * i / count);
+        uint32_t tail = (uint32_t) (job.size() * (i + 1) / count);
+        queues[i].range = packRange(head, tail);
+    }
+    idle = 0;
+    generation++;
+    Clock::time_point begin = Clock::now();
+    start.notify_all();
+
+    finish.wait(lock, [this] {return idle == (int) queues.size();});
+    tiles = NULL;
+    function = NULL;
+    if (timing) {
+        double wall = secondsBetween(begin, Clock::now());
+        for (size_t i = 0; i < worker_stats.size(); i++) worker_stats[i].stats.wall += wall;
+    }
+}
+
+//the workers are idle between jobs, so the stats can be read without a lock
+std::vector<WorkerStats> TileScheduler::getWorkerStats() {
+    std::vector<WorkerStats> stats(worker_stats.size());
+    for (size_t i = 0; i < worker_stats.size(); i++) stats[i] = worker_stats[i].stats;
+    return stats;
+}
+
+void TileScheduler::resetWorkerStats() {
+    for (size_t i = 0; i < worker_stats.size(); i++) worker_stats[i].stats = WorkerStats();
+}
+
+//the worker loop: wait for a job, do the own queue, then steal until there is
+//nothing left anywhere
+void TileScheduler::work(int worker) {
+    int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (++idle == (int) queues.size()) finish.notify_one();
+            start.wait(lock, [this, seen] {return stopping || generation != seen;});
+            if (stopping) return;
+            seen = generation;
+        }
+
+        int tile;
+        int count = (int) queues.size();
+        WorkerStats& stats = worker_stats[worker].stats;
+        while (true) {
+            bool stolen = false;
+            if (!popFront(worker, tile)) {
+                //steal from the other queues, starting with the next one along
+                for (int i = 1; i < count && !stolen; i++) {
+                    stolen = popBack((worker + i) % count, tile);
+                }
+                if (!stolen) break;
+            }
+
+            if (!timing) {
+                (*function)((*tiles)[tile], worker);
+                continue;
+            }
+            Clock::time_point begin = Clock::now();
+            (*function)((*tiles)[tile], worker);
+            stats.busy += secondsBetween(begin, Clock::now());
+            stats.tiles++;
+            if (stolen) stats.steals++;
+        }
+    }
+}
+
+//takes a tile from the front of a queue, for its owner
+bool TileScheduler::popFront(int queue, int& tile) {
+    std::atomic<uint64_t>& range = queues[queue].range;
+    uint64_t old = range.load();
+    while (true) {
+        uint32_t head = (uint32_t) (old >> 32);
+        uint32_t tail = (uint32_t) old;
+        if (head >= tail) return false;
+        if (range.compare_exchange_weak(old, packRange(head + 1, tail))) {
+            tile = (int) head;
+            return true;
+        }
+    }
+}
+
+//takes a tile from the back of a queue, for a thief
+bool TileScheduler::popBack(int queue, int& tile) {
+    std::atomic<uint64_t>& range = queues[queue].range;
+    uint64_t old = range.load();
+    while (true) {
+        uint32_t head = (uint32_t) (old >> 32);
+        uint32_t tail = (uint32_t) old;
+        if (head >= tail) return false;
+        if (range.compare_exchange_weak(old, packRange(head, tail - 1))) {
+            tile = (int) (tail - 1);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef MANDELBROTSCHEDULER_H
+#define MANDELBROTSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//a rectangle of pixels that one worker generates at a time
+struct Tile {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+//splits a width x height image into tiles of at most size x size pixels, in
+//scanline order. The tiles are laid out as if the image started offset_x,
+//offset_y pixels into the first one, which is cut short
+std::vector<Tile> makeTiles(int width, int height, int size, int offset_x = 0, int offset_y = 0);
+
+//what one worker did while timing was on. busy is the time spent in the tile
+//function, wall the time the jobs it took part in took from start to finish,
+//so wall - busy is how long it was idle or looking for tiles
+struct WorkerStats {
+    double busy;
+    double wall;
+    long long tiles;
+    long long steals;
+};
+
+//TileScheduler is a pool of worker threads that stays alive between renders.
+//Each call to run() deals the tiles out to per-worker queues; a worker takes
+//tiles from the front of its own queue, and when that is empty it steals from
+//the back of the others. The queues are lock-free, so there are no global locks
+//while the tiles are being generated.
+class TileScheduler {
+    public:
+        //the function each worker calls for a tile, with its worker number
+        typedef std::function<void (const Tile&, int)> TileFunction;
+
+        //creates the workers, 0 threads means one per hardware thread
+        TileScheduler(int threads);
+        ~TileScheduler();
+
+        int getThreads() {return (int) queues.size();}
+
+        //generates all the tiles and returns once they are all done
+        void run(const std::vector<Tile>& tiles, const TileFunction& function);
+
+        //turns timing of the workers on or off. It only costs two clock reads
+        //per tile while it's on
+        void setTiming(bool enable) {timing = enable;}
+        std::vector<WorkerStats> getWorkerStats();
+        void resetWorkerStats();
+
+    private:
+        //each worker's queue is a range [head, tail) of the tile list, packed into
+        //one word so that the owner and the thieves can both take tiles with a
+        //compare-and-swap
+        struct Queue {
+            std::atomic<uint64_t> range;
+            char padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        //each worker only writes its own stats, which are padded out to a cache
+        //line so they don't share one
+        struct PaddedStats {
+            WorkerStats stats;
+            char padding[64 - sizeof(WorkerStats) % 64];
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<Queue> queues;
+        std::vector<PaddedStats> worker_stats;
+        bool timing;
+
+        //the current job, only changed while all the workers are idle
+        const std::vector<Tile> *tiles;
+        const TileFunction *function;
+
+        //the workers sleep until the generation changes, and the last one to
+        //finish a job wakes up run()
+        std::mutex mutex;
+        std::condition_variable start;
+        std::condition_variable finish;
+        int generation;
+        int idle;
+        bool stopping;
+
+        void work(int worker);
+        bool popFront(int queue, int& tile);
+        bool popBack(int queue, int& tile);
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "mandelbrotStream.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+//packs the rgb of each pixel of a row
+static void packRow(const uint8_t *pixels, int width, uint8_t *rgb) {
+    for (int x = 0; x < width; x++) {
+        rgb[3*x] = pixels[4*x];
+        rgb[3*x + 1] = pixels[4*x + 1];
+        rgb[3*x + 2] = pixels[4*x + 2];
+    }
+}
+
+PpmWriter::PpmWriter() {
+    file = NULL;
+    width = 0;
+}
+
+PpmWriter::~PpmWriter() {
+    if (file != NULL) fclose(file);
+}
+
+bool PpmWriter::open(const std::string& filename, int w, int h) {
+    file = fopen(filename.c_str(), "wb");
+    if (file == NULL) return false;
+    width = w;
+    row.resize((size_t) width * 3);
+    return fprintf(file, "P6\n%d %d\n255\n", w, h) > 0;
+}
+
+bool PpmWriter::writeRows(const uint8_t *pixels, int count) {
+    for (int y = 0; y < count; y++) {
+        packRow(pixels + (size_t) y * width * 4, width, &row[0]);
+        if (fwrite(&row[0], 1, row.size(), file) != row.size()) return false;
+    }
+    return true;
+}
+
+bool PpmWriter::close() {
+    if (file == NULL) return false;
+    bool ok = fclose(file) == 0;
+    file = NULL;
+    return ok;
+}
+
+#ifdef USE_ZLIB
+static const uint8_t png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+//the compressed data is written out in IDAT chunks of this size
+static const size_t png_chunk = 1 << 20;
+
+//PNG stores numbers big endian
+static void putBigEndian(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t) (value >> 24);
+    out[1] = (uint8_t) (value >> 16);
+    out[2] = (uint8_t) (value >> 8);
+    out[3] = (uint8_t) value;
+}
+
+PngWriter::PngWriter() {
+    file = NULL;
+    width = 0;
+    stream = NULL;
+}
+
+PngWriter::~PngWriter() {
+    if (stream != NULL) {
+        deflateEnd((z_stream *) stream);
+        delete (z_stream *) stream;
+    }
+    if (file != NULL) fclose(file);
+}
+
+bool PngWriter::open(const std::string& filename, int w, int h) {
+    file = fopen(filename.c_str(), "wb");
+    if (file == NULL) return false;
+    width = w;
+
+    //each row starts with its filter type, which is always none
+    row.resize((size_t) width * 3 + 1);
+    row[0] = 0;
+    compressed.resize(png_chunk);
+
+    //the fastest compression still does well on the large areas of one color,
+    //and keeps the writer from falling behind the workers
+    z_stream *z = new z_stream();
+    stream = z;
+    if (deflateInit(z, Z_BEST_SPEED) != Z_OK) return false;
+    z->next_out = &compressed[0];
+    z->avail_out = (uInt) compressed.size();
+
+    //8 bit rgb, no interlacing
+    uint8_t header[13];
+    putBigEndian(header, (uint32_t) w);
+    putBigEndian(header + 4, (uint32_t) h);
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = header[11] = header[12] = 0;
+    return fwrite(png_signature, 1, sizeof(png_signature), file) == sizeof(png_signature) &&
+           writeChunk("IHDR", header, sizeof(header));
+}
+
+bool PngWriter::writeRows(const uint8_t *pixels, int count) {
+    for (int y = 0; y < count; y++) {
+        packRow(pixels + (size_t) y * width * 4, width, &row[1]);
+        if (!deflateRow(&row[0], row.size(), false)) return false;
+    }
+    return true;
+}
+
+bool PngWriter::close() {
+    if (file == NULL || stream == NULL) return false;
+    bool ok = deflateRow(NULL, 0, true) && writeChunk("IEND", NULL, 0);
+    ok = fclose(file) == 0 && ok;
+    file = NULL;
+    return ok;
+}
+
+//a chunk is its length, type, data and a crc of the type and data
+bool PngWriter::writeChunk(const char *type, const uint8_t *data, size_t size) {
+    uint8_t head[8];
+    putBigEndian(head, (uint32_t) size);
+    memcpy(head + 4, type, 4);
+    uLong crc = crc32(0, head + 4, 4);
+    if (size > 0) crc = crc32(crc, data, (uInt) size);
+    uint8_t tail[4];
+    putBigEndian(tail, (uint32_t) crc);
+    return fwrite(head, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) &&
+           fwrite(tail, 1, 4, file) == 4;
+}
+
+bool PngWriter::deflateRow(const uint8_t *data, size_t size, bool flush) {
+    z_stream *z = (z_stream *) stream;
+    z->next_in = (Bytef *) data;
+    z->avail_in = (uInt) size;
+    while (true) {
+        int result = deflate(z, flush ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_ERROR) return false;
+
+        //write out the buffer once it's full, or at the end
+        bool full = z->avail_out == 0;
+        if (full || (flush && result == Z_STREAM_END)) {
+            if (!writeChunk("IDAT", &compressed[0], compressed.size() - z->avail_out)) return false;
+            z->next_out = &compressed[0];
+            z->avail_out = (uInt) compressed.size();
+        }
+        if (flush ? result == Z_STREAM_END : (z->avail_in == 0 && !full)) return true;
+    }
+}
+#endif
+
+ImageWriter *createImageWriter(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    if (extension == "ppm") return new PpmWriter();
+#ifdef USE_ZLIB
+    if (extension == "png") return new PngWriter();
+#endif
+    return NULL;
+}
+
+//the bands waiting for the writer thread. An empty band means there are no more
+struct BandQueue {
+    std::deque<std::vector<uint8_t> > bands;
+    std::vector<std::vector<uint8_t> > spare;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool failed;
+};
+
+bool renderBands(MandelbrotEngine& engine, int height, ImageWriter& writer, int queue_bands,
+                 const BandFunction& progress, StreamStats& stats) {
+    int width = engine.getWidth();
+    int band = engine.getHeight();
+    stats = StreamStats();
+    if ((height - band) % 2 != 0) return false;
+    sf::Clock clock;
+
+    //the writer takes the bands in order and hands their memory back, so there
+    //are never more than queue_bands + 1 of them
+    BandQueue queue;
+    queue.failed = false;
+    std::thread writing([&queue, &writer, width] () {
+        while (true) {
+            std::vector<uint8_t> pixels;
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.changed.wait(lock, [&queue] {return !queue.bands.empty();});
+                pixels.swap(queue.bands.front());
+                queue.bands.pop_front();
+            }
+            if (pixels.empty()) return;
+            bool ok = writer.writeRows(&pixels[0], (int) (pixels.size() / ((size_t) width * 4)));
+
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!ok) queue.failed = true;
+            queue.spare.push_back(std::vector<uint8_t>());
+            queue.spare.back().swap(pixels);
+            queue.changed.notify_all();
+        }
+    });
+
+    //the engine's middle row starts on the middle row of the top band. The
+    //pan keeps it on the same grid of pixels as the whole image, which is why
+    //the band and the image have to both be even or both be odd
+    engine.panPixels(0, band / 2 - height / 2);
+    bool failed = false;
+    for (int top = 0; top < height && !failed; top += band) {
+        engine.generate();
+        const RenderStats& render = engine.getStats();
+        stats.pixels += render.pixels;
+        stats.iterations += render.kernel.iterations;
+        stats.bands++;
+
+        //wait for room in the queue, then copy the band into it. The last band
+        //only has the rows that are in the image
+        int rows = std::min(band, height - top);
+        std::vector<uint8_t> pixels;
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.changed.wait(lock, [&queue, queue_bands] {
+                return (int) queue.bands.size() < queue_bands || queue.failed;
+            });
+            failed = queue.failed;
+            if (!queue.spare.empty()) {
+                pixels.swap(queue.spare.back());
+                queue.spare.pop_back();
+            }
+        }
+        pixels.resize((size_t) width * rows * 4);
+        engine.getFramebuffer().copyRect(0, 0, width, rows, &pixels[0]);
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.bands.push_back(std::vector<uint8_t>());
+            queue.bands.back().swap(pixels);
+            queue.changed.notify_all();
+        }
+        if (progress) progress(top + rows);
+        engine.panPixels(0, band);
+    }
+
+    //the empty band stops the writer once it has written the rest
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.bands.push_back(std::vector<uint8_t>());
+        queue.changed.notify_all();
+    }
+    writing.join();
+    stats.seconds = clock.getElapsedTime().asSeconds();
+    return !queue.failed;
+}
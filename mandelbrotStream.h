@@ -0,0 +1,96 @@
+#ifndef MANDELBROTSTREAM_H
+#define MANDELBROTSTREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "mandelbrotEngine.h"
+
+//ImageWriter writes an image a few rows at a time, from the top down, so the
+//whole image never has to be in memory at once
+class ImageWriter {
+    public:
+        virtual ~ImageWriter() {}
+
+        //starts a width x height image in the given file
+        virtual bool open(const std::string& filename, int width, int height) = 0;
+
+        //writes the next count rows, as RGBA pixels packed width * 4 bytes apart.
+        //The alpha is dropped
+        virtual bool writeRows(const uint8_t *pixels, int count) = 0;
+
+        //finishes the file, it's only complete once this returns true. False
+        //if nothing was opened
+        virtual bool close() = 0;
+};
+
+//PpmWriter writes binary PPM, which is just a header and the rows
+class PpmWriter : public ImageWriter {
+    public:
+        PpmWriter();
+        ~PpmWriter();
+        bool open(const std::string& filename, int width, int height);
+        bool writeRows(const uint8_t *pixels, int count);
+        bool close();
+
+    private:
+        FILE *file;
+        int width;
+        std::vector<uint8_t> row;
+};
+
+#ifdef USE_ZLIB
+//PngWriter compresses the rows as they come in, and writes the compressed data
+//out in IDAT chunks whenever its buffer fills up
+class PngWriter : public ImageWriter {
+    public:
+        PngWriter();
+        ~PngWriter();
+        bool open(const std::string& filename, int width, int height);
+        bool writeRows(const uint8_t *pixels, int count);
+        bool close();
+
+    private:
+        FILE *file;
+        int width;
+        std::vector<uint8_t> row;
+        std::vector<uint8_t> compressed;
+
+        //the zlib stream, which is only allocated while the file is open
+        void *stream;
+
+        bool writeChunk(const char *type, const uint8_t *data, size_t size);
+
+        //compresses the row and writes out whatever fills the buffer. flush
+        //finishes the stream
+        bool deflateRow(const uint8_t *data, size_t size, bool flush);
+};
+#endif
+
+//returns a writer for the file's extension (.ppm, or .png if this build has
+//zlib), or NULL if there isn't one. The caller deletes it
+ImageWriter *createImageWriter(const std::string& filename);
+
+//what a streaming render did, added up over all its bands
+struct StreamStats {
+    double seconds;
+    long long pixels;
+    long long iterations;
+    int bands;
+};
+
+//renders a width x height image in bands as tall as the engine, and streams
+//the bands to the writer in order as they are done. The engine should be set
+//up for the view as if it were the whole image: the same width, spacing and
+//center, and it is moved to the top band first. Its height has to be even if
+//the image's is, and odd if it's odd. The writer has its own thread,
+//so it encodes one band while the workers render the next, and at most
+//queue_bands bands wait for it. progress is called with the rows done after
+//each band. Returns false if the writer failed or the heights don't match
+typedef std::function<void (int)> BandFunction;
+bool renderBands(MandelbrotEngine& engine, int height, ImageWriter& writer, int queue_bands,
+                 const BandFunction& progress, StreamStats& stats);
+
+#endif
@@ -0,0 +1,105 @@
+#include "mandelbrotTileCache.h"
+#include <functional>
+
+//mixes the fields of the key together
+size_t TileKeyHash::operator()(const TileKey& key) const {
+    std::hash<long long> hash;
+    size_t h = hash(key.x);
+    h = h * 31 + hash(key.y);
+    h = h * 31 + hash(key.level);
+    h = h * 31 + hash((long long) key.grid);
+    h = h * 31 + hash(key.max_iter);
+    h = h * 31 + hash(key.precision);
+    h = h * 31 + hash(key.approximations);
+    return h;
+}
+
+TileCache::TileCache() {
+    budget = 0;
+    stats = CacheStats();
+}
+
+size_t TileCache::getBudget() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+CacheStats TileCache::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void TileCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    evict(0);
+}
+
+//a hit moves the tile to the front, so it is the last to be dropped
+bool TileCache::find(const TileKey& key, int *iters, int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        stats.misses++;
+        return false;
+    }
+    stats.hits++;
+    entries.splice(entries.begin(), entries, found->second);
+
+    const Entry& entry = *found->second;
+    if (!entry.compact.empty()) {
+        for (int i = 0; i < count; i++) iters[i] = entry.compact[i];
+    } else {
+        for (int i = 0; i < count; i++) iters[i] = (int) entry.wide[i];
+    }
+    return true;
+}
+
+void TileCache::insert(const TileKey& key, const int *iters, int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (budget == 0) return;
+
+    //the bytes a tile takes, counting the list and index nodes roughly
+    bool compact = key.max_iter <= 65535;
+    size_t bytes = count * (compact ? sizeof(uint16_t) : sizeof(uint32_t)) + sizeof(Entry) +
+                   4 * sizeof(void *);
+    if (bytes > budget) return;
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+        stats.bytes -= found->second->bytes;
+        stats.tiles--;
+        entries.erase(found->second);
+        index.erase(found);
+    }
+    evict(bytes);
+
+    entries.push_front(Entry());
+    Entry& entry = entries.front();
+    entry.key = key;
+    entry.bytes = bytes;
+    if (compact) entry.compact.assign(iters, iters + count);
+    else entry.wide.assign(iters, iters + count);
+    index[key] = entries.begin();
+    stats.bytes += bytes;
+    stats.tiles++;
+}
+
+void TileCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    stats = CacheStats();
+}
+
+//the caller holds the lock
+void TileCache::evict(size_t bytes) {
+    while (!entries.empty() && stats.bytes + bytes > budget) {
+        const Entry& entry = entries.back();
+        stats.bytes -= entry.bytes;
+        stats.tiles--;
+        stats.evictions++;
+        index.erase(entry.key);
+        entries.pop_back();
+    }
+}
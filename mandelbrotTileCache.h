@@ -0,0 +1,103 @@
+#ifndef MANDELBROTTILECACHE_H
+#define MANDELBROTTILECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//identifies a square tile of escape times on a quadtree over the complex plane.
+//grid is a hash of the grid the quadtree starts from, level is how many times
+//its pixels were halved (negative if they were doubled), and x, y is the tile's
+//position counted in tiles of that level. The escape times also
+//depend on max_iter, the precision tier they were generated with and the
+//approximations that were on (see TileApproximation), which can make them
+//differ from an exact render
+struct TileKey {
+    uint64_t grid;
+    int level;
+    long long x;
+    long long y;
+    int max_iter;
+    int precision;
+    int approximations;
+
+    bool operator==(const TileKey& other) const {
+        return grid == other.grid && level == other.level && x == other.x && y == other.y &&
+               max_iter == other.max_iter && precision == other.precision &&
+               approximations == other.approximations;
+    }
+};
+
+//the flags of TileKey::approximations
+enum TileApproximation {
+    TILE_SUBDIVIDED = 1,
+    TILE_SERIES = 2
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey& key) const;
+};
+
+//what the cache did since it was created or cleared, and what is in it now
+struct CacheStats {
+    long long hits;
+    long long misses;
+    long long evictions;
+    size_t bytes;
+    size_t tiles;
+};
+
+//TileCache keeps the escape times of recently generated tiles within a memory
+//budget. When a new tile doesn't fit, the least recently used ones are dropped.
+//Tiles with a max_iter that fits in 16 bits are stored as uint16_t, like the
+//IterationBuffer. The worker threads share it, so every function takes the lock
+class TileCache {
+    public:
+        TileCache();
+
+        //the cache owns its tiles, so it can't be copied
+        TileCache(const TileCache&) = delete;
+        TileCache& operator=(const TileCache&) = delete;
+
+        //Accesor functions:
+        size_t getBudget();
+        CacheStats getStats();
+
+        //sets the memory budget in bytes, dropping tiles until they fit. A budget
+        //of 0 turns the cache off
+        void setBudget(size_t bytes);
+
+        //copies the count escape times of the tile into iters and returns true if
+        //the tile is cached
+        bool find(const TileKey& key, int *iters, int count);
+
+        //stores a copy of the tile's escape times, replacing any it already had
+        void insert(const TileKey& key, const int *iters, int count);
+
+        //drops every tile and resets the counters
+        void clear();
+
+    private:
+        struct Entry {
+            TileKey key;
+            std::vector<uint16_t> compact;
+            std::vector<uint32_t> wide;
+            size_t bytes;
+        };
+
+        //the most recently used tile is at the front
+        std::list<Entry> entries;
+        std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> index;
+
+        size_t budget;
+        CacheStats stats;
+        std::mutex mutex;
+
+        //drops the least recently used tiles until bytes more would fit
+        void evict(size_t bytes);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "mandelbrotTileStore.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char store_magic[8] = {'M', 'A', 'N', 'D', 'T', 'I', 'L', 'E'};
+static const uint32_t store_version = 2;
+
+//FNV-1a, a word at a time
+static uint64_t mix(uint64_t h, uint64_t value) {
+    h ^= value;
+    return h * 1099511628211ULL;
+}
+
+TileStore::TileStore() {
+    file = -1;
+    map = NULL;
+    map_size = 0;
+    tile_size = 0;
+    capacity = 0;
+    slots = NULL;
+    tiles = NULL;
+    stats = StoreStats();
+}
+
+TileStore::~TileStore() {
+    close();
+}
+
+bool TileStore::open(const std::string& path, int size, size_t slots_wanted) {
+    close();
+    file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0) return false;
+    if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "The tile store " << path << " is in use by another process" << std::endl;
+        close();
+        return false;
+    }
+
+    //use the file as it is if its header checks out
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close();
+        return false;
+    }
+    Header header;
+    bool existing = info.st_size >= (off_t) sizeof(Header) &&
+                    pread(file, &header, sizeof(Header), 0) == (ssize_t) sizeof(Header) &&
+                    memcmp(header.magic, store_magic, sizeof(store_magic)) == 0 &&
+                    header.version == store_version && header.tile_size > 0 && header.capacity > 0 &&
+                    header.size == fileSize(header.tile_size, header.capacity) &&
+                    header.size == (uint64_t) info.st_size;
+    if (existing && (int) header.tile_size != size) {
+        std::cerr << "The tile store " << path << " has tiles of " << header.tile_size
+                  << " pixels, not " << size << std::endl;
+        close();
+        return false;
+    }
+    if (!existing && info.st_size > 0) {
+        std::cerr << "The tile store " << path << " is damaged or from another version, starting it over"
+                  << std::endl;
+    }
+
+    tile_size = size;
+    capacity = existing ? header.capacity : slots_wanted;
+    map_size = fileSize(tile_size, capacity);
+    if (!existing && (ftruncate(file, 0) != 0 || ftruncate(file, map_size) != 0)) {
+        close();
+        return false;
+    }
+    if (!mapFile(existing)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TileStore::close() {
+    if (map != NULL) munmap(map, map_size);
+    if (file >= 0) ::close(file);
+    file = -1;
+    map = NULL;
+    slots = NULL;
+    tiles = NULL;
+    stats = StoreStats();
+}
+
+StoreStats TileStore::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+//follows the slots from the key's first one until it finds the key or an
+//empty slot, then checks the tile against its checksum outside the lock. A
+//tile whose checksum doesn't match is marked to be written again, unless it
+//was written again while it was being checked
+const uint32_t *TileStore::find(const TileKey& key) {
+    Slot *slot = NULL;
+    const uint32_t *tile = NULL;
+    uint64_t expected = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t i = firstSlot(key);
+        for (size_t n = 0; n < capacity; n++, i = (i + 1) % capacity) {
+            uint32_t state = __atomic_load_n(&slots[i].state, __ATOMIC_ACQUIRE);
+            if (state == SLOT_EMPTY) break;
+            if (!matches(slots[i], key)) continue;
+
+            if (state == SLOT_DONE) {
+                slot = &slots[i];
+                tile = tiles + i * (size_t) tile_size * tile_size;
+                expected = slot->checksum;
+            }
+            break;
+        }
+        if (slot == NULL) {
+            stats.misses++;
+            return NULL;
+        }
+    }
+
+    //a slot keeps its key once it has one, so only the tile can change under
+    //the check, and then the checksum is written again too
+    bool intact = checksum(*slot, tile) == expected;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (intact) {
+        stats.hits++;
+        return tile;
+    }
+    if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == SLOT_DONE && slot->checksum == expected) {
+        stats.damaged++;
+        stats.tiles--;
+        __atomic_store_n(&slot->state, (uint32_t) SLOT_WRITING, __ATOMIC_RELEASE);
+    }
+    stats.misses++;
+    return NULL;
+}
+
+//claims the key's slot, or the first empty one after it, then writes the tile
+//outside the lock. The slot only counts once it is marked as done
+bool TileStore::insert(const TileKey& key, const int *iters) {
+    Slot *slot = NULL;
+    uint32_t *tile = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t i = firstSlot(key);
+        for (size_t n = 0; n < capacity; n++, i = (i + 1) % capacity) {
+            uint32_t state = __atomic_load_n(&slots[i].state, __ATOMIC_ACQUIRE);
+            if (state == SLOT_EMPTY || matches(slots[i], key)) {
+                slot = &slots[i];
+                tile = tiles + i * (size_t) tile_size * tile_size;
+                if (state == SLOT_DONE) stats.tiles--;
+                break;
+            }
+        }
+        if (slot == NULL) return false;
+
+        slot->grid = key.grid;
+        slot->x = key.x;
+        slot->y = key.y;
+        slot->level = key.level;
+        slot->max_iter = key.max_iter;
+        slot->precision = key.precision;
+        slot->approximations = key.approximations;
+        __atomic_store_n(&slot->state, (uint32_t) SLOT_WRITING, __ATOMIC_RELEASE);
+    }
+
+    int count = tile_size * tile_size;
+    for (int i = 0; i < count; i++) tile[i] = (uint32_t) iters[i];
+    slot->checksum = checksum(*slot, tile);
+    __atomic_store_n(&slot->state, (uint32_t) SLOT_DONE, __ATOMIC_RELEASE);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.writes++;
+    stats.tiles++;
+    return true;
+}
+
+size_t TileStore::fileSize(int tile_size, size_t capacity) {
+    return sizeof(Header) + capacity * sizeof(Slot) + capacity * (size_t) tile_size * tile_size * sizeof(uint32_t);
+}
+
+bool TileStore::mapFile(bool existing) {
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return false;
+    }
+    Header *header = (Header *) map;
+    slots = (Slot *) (header + 1);
+    tiles = (uint32_t *) (slots + capacity);
+
+    //a new file gets its header, which the zeros of the sparse file already
+    //leave every slot empty for
+    if (!existing) {
+        memcpy(header->magic, store_magic, sizeof(store_magic));
+        header->version = store_version;
+        header->tile_size = tile_size;
+        header->capacity = capacity;
+        header->size = map_size;
+    }
+
+    stats = StoreStats();
+    stats.capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        if (slots[i].state == SLOT_DONE) stats.tiles++;
+    }
+    return true;
+}
+
+bool TileStore::matches(const Slot& slot, const TileKey& key) const {
+    return slot.grid == key.grid && slot.x == key.x && slot.y == key.y && slot.level == key.level &&
+           slot.max_iter == key.max_iter && slot.precision == key.precision &&
+           slot.approximations == key.approximations;
+}
+
+//covers the key as well as the escape times, so a slot that was only partly
+//written is caught
+uint64_t TileStore::checksum(const Slot& slot, const uint32_t *tile) const {
+    uint64_t h = 14695981039346656037ULL;
+    h = mix(h, slot.grid);
+    h = mix(h, (uint64_t) slot.x);
+    h = mix(h, (uint64_t) slot.y);
+    h = mix(h, (uint32_t) slot.level);
+    h = mix(h, (uint32_t) slot.max_iter);
+    h = mix(h, (uint32_t) slot.precision);
+    h = mix(h, (uint32_t) slot.approximations);
+    int count = tile_size * tile_size;
+    for (int i = 0; i < count; i++) h = mix(h, tile[i]);
+    return h;
+}
+
+//the hash is spelled out, so it's the same in every build
+size_t TileStore::firstSlot(const TileKey& key) const {
+    uint64_t h = 14695981039346656037ULL;
+    h = mix(h, key.grid);
+    h = mix(h, (uint64_t) key.x);
+    h = mix(h, (uint64_t) key.y);
+    h = mix(h, (uint32_t) key.level);
+    h = mix(h, (uint32_t) key.max_iter);
+    h = mix(h, (uint32_t) key.precision);
+    h = mix(h, (uint32_t) key.approximations);
+    return (size_t) (h % capacity);
+}
@@ -0,0 +1,107 @@
+#ifndef MANDELBROTTILESTORE_H
+#define MANDELBROTTILESTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "mandelbrotTileCache.h"
+
+//what the store did since it was opened
+struct StoreStats {
+    long long hits;
+    long long misses;
+    long long writes;
+    long long damaged;
+    size_t tiles;
+    size_t capacity;
+};
+
+//TileStore keeps tiles of escape times on disk, in one memory-mapped file, so
+//they can be used again by later runs. The file has a header, then an index
+//that is a hash table of capacity slots keyed like the TileCache, then the
+//escape times of each slot's tile as uint32_t. The file is made at its full
+//size up front, so it is sparse until the tiles are written.
+//
+//A slot is only trusted once it is complete: its key and tile are written
+//first, then a checksum of both, and only then is it marked as done. A slot
+//that was left half written or doesn't match its checksum is treated as missing,
+//and written again. A file whose header doesn't match is started over.
+//Only one process can have a store open at a time
+class TileStore {
+    public:
+        TileStore();
+        ~TileStore();
+
+        //the store owns the mapping, so it can't be copied
+        TileStore(const TileStore&) = delete;
+        TileStore& operator=(const TileStore&) = delete;
+
+        //opens the store in the given file for tiles of tile_size x tile_size
+        //escape times, making it with room for capacity tiles if it doesn't
+        //exist or can't be used. Returns false if the file can't be opened
+        bool open(const std::string& path, int tile_size, size_t capacity);
+        void close();
+
+        //Accesor functions:
+        bool isOpen() const {return map != NULL;}
+        int getTileSize() const {return tile_size;}
+        StoreStats getStats();
+
+        //returns the tile's escape times straight from the file, or NULL if it
+        //isn't in the store or is damaged. The pointer stays valid until the
+        //store is closed
+        const uint32_t *find(const TileKey& key);
+
+        //writes the tile's escape times, returns false if the store is full
+        bool insert(const TileKey& key, const int *iters);
+
+    private:
+        //the header at the start of the file
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t tile_size;
+            uint64_t capacity;
+            uint64_t size;
+        };
+
+        //one slot of the index. state is empty, being written or done
+        struct Slot {
+            uint64_t grid;
+            int64_t x;
+            int64_t y;
+            int32_t level;
+            int32_t max_iter;
+            int32_t precision;
+            int32_t approximations;
+            uint32_t state;
+            uint64_t checksum;
+        };
+        enum {SLOT_EMPTY = 0, SLOT_WRITING = 1, SLOT_DONE = 2};
+
+        int file;
+        void *map;
+        size_t map_size;
+        int tile_size;
+        size_t capacity;
+        Slot *slots;
+        uint32_t *tiles;
+        StoreStats stats;
+
+        //taken to find or claim a slot, the tiles are checked and written outside
+        //of it
+        std::mutex mutex;
+
+        //the size of the file for a tile size and capacity
+        static size_t fileSize(int tile_size, size_t capacity);
+
+        //maps the file, checking the header if it should already have one
+        bool mapFile(bool existing);
+
+        bool matches(const Slot& slot, const TileKey& key) const;
+        uint64_t checksum(const Slot& slot, const uint32_t *tile) const;
+        size_t firstSlot(const TileKey& key) const;
+};
+
+#endif
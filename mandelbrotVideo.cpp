@@ -0,0 +1,197 @@
+#include "mandelbrotVideo.h"
+#include "mandelbrotStream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+NumberedFrames::NumberedFrames(const std::string& name_pattern, int w, int h) {
+    pattern = name_pattern;
+    width = w;
+    height = h;
+    frame = 0;
+}
+
+bool NumberedFrames::writeFrame(const uint8_t *pixels) {
+    std::vector<char> name(pattern.size() + 32);
+    snprintf(&name[0], name.size(), pattern.c_str(), frame++);
+    ImageWriter *writer = createImageWriter(&name[0]);
+    if (writer == NULL) return false;
+    if (!writer->open(&name[0], width, height)) {
+        delete writer;
+        return false;
+    }
+    bool ok = writer->writeRows(pixels, height);
+    ok = writer->close() && ok;
+    delete writer;
+    return ok;
+}
+
+RawVideo::RawVideo(int w, int h) {
+    file = NULL;
+    width = w;
+    height = h;
+    row.resize((size_t) width * 3);
+}
+
+RawVideo::~RawVideo() {
+    if (file != NULL && file != stdout) fclose(file);
+}
+
+bool RawVideo::open(const std::string& filename) {
+    file = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+    return file != NULL;
+}
+
+bool RawVideo::writeFrame(const uint8_t *pixels) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t *rgba = pixels + (size_t) y * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[3*x] = rgba[4*x];
+            row[3*x + 1] = rgba[4*x + 1];
+            row[3*x + 2] = rgba[4*x + 2];
+        }
+        if (fwrite(&row[0], 1, row.size(), file) != row.size()) return false;
+    }
+    return true;
+}
+
+bool RawVideo::close() {
+    bool ok = file == stdout ? fflush(file) == 0 : fclose(file) == 0;
+    file = NULL;
+    return ok;
+}
+
+FrameSink *createFrameSink(const std::string& output, int width, int height) {
+    std::string extension = output.substr(output.find_last_of('.') + 1);
+    if (output == "-" || extension == "rgb" || extension == "raw") {
+        RawVideo *video = new RawVideo(width, height);
+        if (video->open(output)) return video;
+        delete video;
+        return NULL;
+    }
+
+    //the pattern has to have exactly one number in it, and be for an image
+    //the streaming writers know
+    size_t percent = output.find('%');
+    if (percent == std::string::npos || output.find('%', percent + 1) != std::string::npos) return NULL;
+    size_t end = output.find_first_not_of("0123456789", percent + 1);
+    if (end == std::string::npos || output[end] != 'd') return NULL;
+    ImageWriter *writer = createImageWriter(output);
+    if (writer == NULL) return NULL;
+    delete writer;
+    return new NumberedFrames(output, width, height);
+}
+
+//where a frame pixel's samples come from along one axis: three keyframe
+//pixels, each with its weight out of 256. A frame pixel never covers more than
+//two keyframe pixels, so it touches at most three
+struct Span {
+    int index[3];
+    int weight[3];
+};
+
+//a frame pixel covers ratio keyframe pixels along each axis, around the place
+//it is relative to the middle pixel. Each keyframe pixel is weighted by how
+//much of it is covered, and the ones past the edge are the edge pixel again.
+//The rounding is left on the biggest weight, so they always add up to 256
+static void makeSpans(int size, int key_size, double ratio, std::vector<Span>& spans) {
+    double middle = key_size / 2;
+    spans.resize(size);
+    for (int u = 0; u < size; u++) {
+        double low = middle + (u - size / 2.0) * ratio - ratio / 2.0;
+        double high = low + ratio;
+        Span& span = spans[u];
+        int first = (int) std::floor(low + 0.5);
+        int total = 0;
+        int biggest = 0;
+        for (int i = 0; i < 3; i++) {
+            int pixel = first + i;
+            double covered = std::max(0.0, std::min(high, pixel + 0.5) - std::max(low, pixel - 0.5));
+            span.index[i] = std::min(std::max(pixel, 0), key_size - 1);
+            span.weight[i] = (int) (256.0 * covered / ratio + 0.5);
+            total += span.weight[i];
+            if (span.weight[i] > span.weight[biggest]) biggest = i;
+        }
+        span.weight[biggest] += 256 - total;
+    }
+}
+
+//adds up three pixels with weights that add up to 256, two bytes at a time.
+//Each byte's sum is at most 255 * 256, so it stays in its 16 bits
+static uint32_t blendPixels(uint32_t a, uint32_t b, uint32_t c, const int *weight) {
+    uint32_t red_blue = (a & 0x00FF00FF) * weight[0] + (b & 0x00FF00FF) * weight[1] +
+                        (c & 0x00FF00FF) * weight[2] + 0x00800080;
+    uint32_t green_alpha = ((a >> 8) & 0x00FF00FF) * weight[0] + ((b >> 8) & 0x00FF00FF) * weight[1] +
+                           ((c >> 8) & 0x00FF00FF) * weight[2] + 0x00800080;
+    return ((red_blue >> 8) & 0x00FF00FF) | (green_alpha & 0xFF00FF00);
+}
+
+//resamples the frame out of the keyframe, each worker doing a tile of it. Each
+//row of the tile blends the keyframe rows it covers across first, then those
+//blended rows down
+static void resampleFrame(const std::vector<uint32_t>& key, int key_width, double ratio,
+                          std::vector<uint32_t>& frame, int width, int height, TileScheduler& scheduler) {
+    int key_height = (int) (key.size() / key_width);
+    std::vector<Span> columns, rows;
+    makeSpans(width, key_width, ratio, columns);
+    makeSpans(height, key_height, ratio, rows);
+    const int tile_size = 64;
+    scheduler.run(makeTiles(width, height, tile_size), [&] (const Tile& tile, int) {
+        uint32_t across[3][tile_size];
+        for (int y = tile.y; y < tile.y + tile.height; y++) {
+            const Span& row = rows[y];
+            for (int j = 0; j < 3; j++) {
+                const uint32_t *key_row = &key[(size_t) row.index[j] * key_width];
+                for (int x = 0; x < tile.width; x++) {
+                    const Span& column = columns[tile.x + x];
+                    across[j][x] = blendPixels(key_row[column.index[0]], key_row[column.index[1]],
+                                               key_row[column.index[2]], column.weight);
+                }
+            }
+            uint32_t *out = &frame[(size_t) y * width + tile.x];
+            for (int x = 0; x < tile.width; x++) {
+                out[x] = blendPixels(across[0][x], across[1][x], across[2][x], row.weight);
+            }
+        }
+    });
+}
+
+//the frames of a level zoom from its keyframe's view towards the next one's,
+//with the same factor between each of them. The frame at zoom z has 2/z
+//keyframe pixels across each of its own
+bool renderZoom(MandelbrotEngine& engine, int width, int height, int levels, int frames_per_level,
+                FrameSink& sink, const ZoomFunction& progress, ZoomStats& stats) {
+    int key_width = engine.getWidth();
+    int key_height = engine.getHeight();
+    stats = ZoomStats();
+    if (key_width != 2 * width || key_height != 2 * height || levels < 0 || frames_per_level <= 0) return false;
+
+    TileScheduler scheduler(engine.getThreads());
+    std::vector<uint32_t> key((size_t) key_width * key_height);
+    std::vector<uint32_t> frame((size_t) width * height);
+    for (int level = 0; level <= levels; level++) {
+        //every keyframe after the first is a zoom step from the one before
+        if (level > 0) engine.zoomStep(true);
+        engine.generate();
+        const RenderStats& render = engine.getStats();
+        stats.keyframes++;
+        stats.key_seconds += render.seconds;
+        stats.pixels += render.pixels;
+        stats.reused += render.reused;
+        engine.getFramebuffer().copyRect(0, 0, key_width, key_height, (uint8_t *) &key[0]);
+
+        //the last keyframe only has the frame at its own view
+        int frames = level < levels ? frames_per_level : 1;
+        for (int i = 0; i < frames; i++) {
+            sf::Clock clock;
+            double zoom = std::pow(2.0, (double) i / frames_per_level);
+            resampleFrame(key, key_width, 2.0 / zoom, frame, width, height, scheduler);
+            stats.frame_seconds += clock.restart().asSeconds();
+            if (!sink.writeFrame((const uint8_t *) &frame[0])) return false;
+            stats.write_seconds += clock.getElapsedTime().asSeconds();
+            stats.frames++;
+        }
+        if (progress) progress(stats.frames);
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef MANDELBROTVIDEO_H
+#define MANDELBROTVIDEO_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "mandelbrotEngine.h"
+
+//FrameSink takes the frames of a video one after the other
+class FrameSink {
+    public:
+        virtual ~FrameSink() {}
+
+        //writes the next frame, as RGBA pixels. The alpha is dropped
+        virtual bool writeFrame(const uint8_t *pixels) = 0;
+
+        //finishes the video, it's only complete once this returns true
+        virtual bool close() = 0;
+};
+
+//NumberedFrames saves each frame to its own image, named by putting the frame's
+//number into a printf pattern like "zoom%05d.png"
+class NumberedFrames : public FrameSink {
+    public:
+        NumberedFrames(const std::string& pattern, int width, int height);
+        bool writeFrame(const uint8_t *pixels);
+        bool close() {return true;}
+
+    private:
+        std::string pattern;
+        int width;
+        int height;
+        int frame;
+};
+
+//RawVideo writes the frames one after the other as 8 bit rgb with nothing in
+//between, which is what ffmpeg reads with -f rawvideo -pix_fmt rgb24. The file
+//can be a pipe, and - is the standard output
+class RawVideo : public FrameSink {
+    public:
+        RawVideo(int width, int height);
+        ~RawVideo();
+        bool open(const std::string& filename);
+        bool writeFrame(const uint8_t *pixels);
+        bool close();
+
+    private:
+        FILE *file;
+        int width;
+        int height;
+        std::vector<uint8_t> row;
+};
+
+//returns a sink for the output: RawVideo for -, or a name ending in .rgb or
+//.raw, and NumberedFrames for a pattern with a %d in it. NULL if it's neither,
+//or the file can't be opened. The caller deletes it
+FrameSink *createFrameSink(const std::string& output, int width, int height);
+
+//what a zoom video did. keyframes is the number rendered, and key_seconds the
+//time they took, frame_seconds is the time spent making the frames from them
+//and write_seconds the time spent writing them out
+struct ZoomStats {
+    int keyframes;
+    int frames;
+    long long pixels;
+    long long reused;
+    double key_seconds;
+    double frame_seconds;
+    double write_seconds;
+};
+
+//renders a zoom into the center of the engine's view, halving the size of the
+//view levels times, with frames_per_level frames for each halving and a last
+//one at the end. Only the keyframes are rendered, one per level, and each one
+//is a zoom step from the last so a quarter of its pixels are kept. The frames
+//in between are resampled from the keyframe before them. The engine has to be
+//twice the width and height of the frames, so every frame has between one and
+//two keyframe pixels across each of its own. progress is called with the
+//frames done after each level. Returns false if the sink failed or the engine
+//isn't the right size
+typedef std::function<void (int)> ZoomFunction;
+bool renderZoom(MandelbrotEngine& engine, int width, int height, int levels, int frames_per_level,
+                FrameSink& sink, const ZoomFunction& progress, ZoomStats& stats);
+
+#endif
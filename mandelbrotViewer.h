@@ -2,19 +2,14 @@
 #define MANDELBROTVIEWER_H
 
 #include <SFML/Graphics.hpp>
-#include <vector>
-
-struct Color {
-    int r;
-    int g;
-    int b;
-};
-
-#ifdef USE_SIMD_ALGORITHM
-typedef double v2df __attribute__ ((vector_size (16)));
-typedef int v2si __attribute__ ((vector_size (8)));
-#endif
-
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "mandelbrotEngine.h"
+
+//MandelbrotViewer displays the mandelbrot in a window. All of the generating
+//and coloring is done by its MandelbrotEngine, which renders on a thread of its
+//own so the window keeps handling input and showing the tiles as they finish
 class MandelbrotViewer {
     public:
         //This constructor creates a new viewer with specified resolution
@@ -24,29 +19,54 @@ class MandelbrotViewer {
         //Accesor functions:
         int getResolution() {return resolution;}
         int getFramerate() {return framerateLimit;}
-        double getColorMultiple() {return color_multiple;}
+        double getColorMultiple() {return engine.getColorMultiple();}
+        KernelType getKernel() {return engine.getKernel();}
+        const RenderStats& getStats() {return engine.getStats();}
+        bool getProfiling() {return engine.getProfiling();}
         sf::Vector2i getMousePosition();
         sf::Vector2f getViewCenter() {return view->getCenter();}
         sf::Vector2f getMandelbrotCenter();
-        bool getEvent(sf::Event&);
         bool isOpen();
+
+        //gets the next event. While a render is going, or its last tiles
+        //haven't been shown, it only polls, so the caller can keep updating
+        //the window. Otherwise it waits for one
+        bool getEvent(sf::Event&);
         
         //Setter functions:
-        void setIterations(int iter) {last_max_iter = max_iter; max_iter = iter;}
-        void setColorMultiple(double mult) {color_multiple = mult;}
+        void setIterations(int iter) {engine.setIterations(iter);}
+        void setColorMultiple(double mult) {engine.setColorMultiple(mult);}
         void setFramerate(int rate) {framerateLimit = rate;}
-        void setColorScheme(int newScheme) {scheme = newScheme; initPalette();}
+        void setColorScheme(int newScheme) {engine.setColorScheme(newScheme);}
+
+        //while profiling is on, the profile of each render and the time each
+        //texture upload took are printed
+        void setProfiling(bool enable) {engine.setProfiling(enable);}
         
         //Functions to change parameters for mandelbrot generation:
-        void changeColor();
-        void changePos(sf::Vector2<double> new_center, double zoom_factor);
+        void changeColor() {engine.changeColor();}
+        void changePos(sf::Vector2<double> new_center, double zoom_factor) {engine.changePos(new_center, zoom_factor);}
+        void changePosPixel(sf::Vector2f new_center, double zoom_factor);
         void changePosView(sf::Vector2f new_center, double zoom_factor);
-
-        //Functions ot generate the mandelbrot:
-        void generate();
+        void panPixels(int dx, int dy) {engine.panPixels(dx, dy);}
+        void zoomStep(bool zoom_in) {engine.zoomStep(zoom_in);}
+
+        //Functions to generate the mandelbrot. startRender() has the render
+        //thread generate the current view, as the next generation. Anything
+        //that changes the engine has to stopRender() first, which cancels the
+        //render in progress and waits for it to stop. That takes about as
+        //long as a few thousand iterations, however deep or big the render
+        //is. It returns true if the image was complete
+        void startRender();
+        bool stopRender();
+
+        //returns true once for each render that finished, while the render
+        //thread is idle, so that its stats can be looked at
+        bool takeFinished();
+        void printProfile() {engine.printProfile(std::cout);}
 
         //Functions to reset or update:
-        void resetMandelbrot();
+        void resetMandelbrot() {engine.resetMandelbrot();}
         void refreshWindow();
         void resetView();
         void close();
@@ -62,7 +82,27 @@ class MandelbrotViewer {
     private:
         int resolution;
         int framerateLimit;
-        int nextLine;
+
+        //the engine generates and colors the mandelbrot
+        MandelbrotEngine engine;
+
+        //the render thread runs generate() for each generation that is asked
+        //for. started is the last generation it took, or that was dropped
+        //before it could, and finished the last one it completed. reported is
+        //the last one takeFinished() returned. idle is only used by the window's
+        //thread, it's true once the last upload had everything the render drew
+        std::thread render_thread;
+        std::mutex render_mutex;
+        std::condition_variable render_start;
+        std::condition_variable render_stop;
+        int generation;
+        int started;
+        int finished;
+        int reported;
+        bool rendering;
+        bool quitting;
+        bool idle;
+        void renderLoop();
 
         //These are pointers to each instance's window and view
         //since we can't initialize them yet
@@ -70,51 +110,10 @@ class MandelbrotViewer {
         sf::View *view;
 
         sf::Sprite sprite;
-        sf::Image image;
         sf::Texture texture;
 
-        //Parameters to generate the mandelbrot:
-        
-        //this is the area of the complex plane to generate
-        sf::Rect<double> area;
-        
-        //this changes how the colors are displayed
-        double color_multiple;
-        int scheme;
-
-        //this array stores the number of iterations for each pixel
-        std::vector< std::vector<int> > image_array;
-
-        //maximum number of iterations to check for. Higher values are slower,
-        //but more precise
-        int max_iter;
-        int last_max_iter;
-
-        //Functions:
-        
-        //interpolate returns the increment to get from min to max in range iterations
-        double interpolate(double min, double max, int range) {return (max-min)/range;}
-        double interpolate(double length, int range) {return length/range;}
-
-        //escape calculates the escape-time of given point of the mandelbrot
-#ifdef USE_SIMD_ALGORITHM
-        v2si escape(double x, double y, double x1);
-#else
-        int escape(double x, double y);
-#endif
-
-        //genLine is a function for worker threads: it generates the next line of the
-        //mandelbrot, then moves onto the next, until the entire mandelbrot is generated
-        void genLine();
-
-        //This looks up a color to print according to the escape value given
-        sf::Color findColor(int iter);
-
-        //initialize the color palette. Having a palette helps avoid regenerating the
-        //color scheme each time it is needed
-        int palette[3][256];
-        void initPalette();
-        void smoosh(sf::Color c1, sf::Color c2, int min, int max);
+        //holds a dirty rectangle that isn't full rows while it's uploaded
+        std::vector<sf::Uint8> upload;
 };
 
 #endif
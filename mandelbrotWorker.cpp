@@ -0,0 +1,51 @@
+#include "mandelbrotFarm.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+//MandelWorker joins the tile farm of a MandelRender started with --farm, and
+//generates the tiles it's given until that render is done
+
+//prints how to call the program
+void usage(const char *name) {
+    std::cout << "Usage: " << name << " <address> [options]" << std::endl;
+    std::cout << "  <address>            the coordinator's address, unix:<path> or <host>:<port>" << std::endl;
+    std::cout << "  --threads <n>        number of worker threads (default one per hardware thread)" << std::endl;
+    std::cout << "  --delay <seconds>    wait this long before each tile, to act like a slow machine" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string address;
+    int threads = 0;
+    double delay = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0 && address.empty()) {
+            address = arg;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--threads") {
+            threads = atoi(argv[++i]);
+        } else if (arg == "--delay") {
+            delay = atof(argv[++i]);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (address.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    return runFarmWorker(address, threads, delay, std::cout) ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include "mandelbrotEngine.h"
+#include "mandelbrotVideo.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+//MandelZoom renders a video zooming into a point of the mandelbrot, as numbered
+//images or raw frames for a video encoder
+
+//prints how to call the program
+void usage(const char *name) {
+    std::cout << "Usage: " << name << " [options]" << std::endl;
+    std::cout << "  --center <x> <y>     the point to zoom into (default -0.5 0)" << std::endl;
+    std::cout << "  --from <zoom>        zoom of the first frame, relative to the starting view (default 1)" << std::endl;
+    std::cout << "  --zoom <factor>      zoom of the last frame, rounded to a power of 2 from the first" << std::endl;
+    std::cout << "                       (default 1e-6)" << std::endl;
+    std::cout << "  --iterations <n>     maximum number of iterations (default 1000)" << std::endl;
+    std::cout << "  --size <w> <h>       size of the frames in pixels (default 1280 720)" << std::endl;
+    std::cout << "  --frames <n>         frames for each halving of the view (default 30)" << std::endl;
+    std::cout << "  --scheme <n>         color scheme (default 1)" << std::endl;
+    std::cout << "  --color <mult>       color multiple (default 1)" << std::endl;
+    std::cout << "  --threads <n>        number of worker threads (default one per hardware thread)" << std::endl;
+    std::cout << "  --compare <n>        afterwards, render every nth frame on its own and compare the time" << std::endl;
+    std::cout << "  --output <file>      a pattern for numbered images like zoom%05d.png, or raw rgb" << std::endl;
+    std::cout << "                       frames to a .rgb file, a pipe or - for the standard output" << std::endl;
+    std::cout << "                       (default zoom%05d.ppm)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string center_x = "-0.5";
+    std::string center_y = "0";
+    double from = 1.0;
+    double zoom = 1e-6;
+    int iterations = 1000;
+    int width = 1280;
+    int height = 720;
+    int frames = 30;
+    int scheme = 1;
+    double color_multiple = 1.0;
+    int threads = 0;
+    int compare = 0;
+    std::string output = "zoom%05d.ppm";
+
+    //parse the options, each one is followed by a fixed number of values
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        int values = (arg == "--center" || arg == "--size") ? 2 : 1;
+        if (arg == "--help" || i + values >= argc) {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+
+        if (arg == "--center") {
+            center_x = argv[i+1];
+            center_y = argv[i+2];
+        } else if (arg == "--from") {
+            from = atof(argv[i+1]);
+        } else if (arg == "--zoom") {
+            zoom = atof(argv[i+1]);
+        } else if (arg == "--iterations") {
+            iterations = atoi(argv[i+1]);
+        } else if (arg == "--size") {
+            width = atoi(argv[i+1]);
+            height = atoi(argv[i+2]);
+        } else if (arg == "--frames") {
+            frames = atoi(argv[i+1]);
+        } else if (arg == "--scheme") {
+            scheme = atoi(argv[i+1]);
+        } else if (arg == "--color") {
+            color_multiple = atof(argv[i+1]);
+        } else if (arg == "--threads") {
+            threads = atoi(argv[i+1]);
+        } else if (arg == "--compare") {
+            compare = atoi(argv[i+1]);
+        } else if (arg == "--output") {
+            output = argv[i+1];
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+        i += values;
+    }
+
+    if (width <= 0 || height <= 0 || iterations <= 0 || from <= 0 || zoom <= 0 || zoom > from || frames <= 0) {
+        std::cerr << "Size, iterations and frames must be positive, and the zoom has to go in" << std::endl;
+        return 1;
+    }
+
+    //raw frames on the standard output leave the messages to the standard error
+    std::ostream& log = output == "-" ? std::cerr : std::cout;
+    FrameSink *sink = createFrameSink(output, width, height);
+    if (sink == NULL) {
+        std::cerr << "Can't write frames to " << output << ", it needs a %d and an image extension, "
+                  << "or to be raw" << std::endl;
+        return 1;
+    }
+
+    //the keyframes are twice the size of the frames
+    MandelbrotEngine brot(2 * width, 2 * height, threads);
+    brot.resetMandelbrot();
+    brot.setIterations(iterations);
+    brot.setColorScheme(scheme);
+    brot.setColorMultiple(color_multiple);
+    brot.changePos(brot.getMandelbrotCenter(), from);
+    if (!brot.setCenter(center_x, center_y)) {
+        std::cerr << "Can't read the center " << center_x << " " << center_y << std::endl;
+        delete sink;
+        return 1;
+    }
+    int levels = (int) std::floor(std::log2(from / zoom) + 0.5);
+    int total = levels * frames + 1;
+    log << "Zooming in by 2^" << levels << " in " << total << " frames, from " << levels + 1
+        << " keyframes of " << 2 * width << "x" << 2 * height << std::endl;
+
+    ZoomStats stats;
+    bool ok = renderZoom(brot, width, height, levels, frames, *sink, [&log, total] (int done) {
+        log << "\rWrote " << done << " of " << total << " frames" << std::flush;
+    }, stats);
+    log << std::endl;
+    ok = sink->close() && ok;
+    delete sink;
+    if (!ok) {
+        std::cerr << "Could not write the frames to " << output << std::endl;
+        return 1;
+    }
+
+    double seconds = stats.key_seconds + stats.frame_seconds;
+    log << "Rendered " << stats.keyframes << " keyframes in " << stats.key_seconds << "s, "
+        << stats.pixels << " pixels iterated and " << stats.reused << " kept from the level before" << std::endl;
+    log << "Resampled " << stats.frames << " frames in " << stats.frame_seconds << "s and wrote them in "
+        << stats.write_seconds << "s" << std::endl;
+    log << "Each frame took " << 1000.0 * seconds / stats.frames << "ms to make, counting the keyframes"
+        << std::endl;
+    if (compare <= 0) return 0;
+
+    //render some of the frames from scratch at their own size, and at the
+    //keyframes' size, which is as sharp as the frames made from them
+    for (int scale = 1; scale <= 2; scale++) {
+        MandelbrotEngine single(scale * width, scale * height, threads);
+        single.setColorScheme(scheme);
+        double single_seconds = 0.0;
+        int rendered = 0;
+        for (int frame = 0; frame < total; frame += compare) {
+            single.resetMandelbrot();
+            single.setIterations(iterations);
+            single.setColorMultiple(color_multiple);
+            single.changePos(single.getMandelbrotCenter(), from * std::pow(0.5, (double) frame / frames));
+            single.setCenter(center_x, center_y);
+            single.generate();
+            single_seconds += single.getStats().seconds;
+            rendered++;
+        }
+        log << "Rendering " << rendered << " of the frames on their own at " << scale * width << "x"
+            << scale * height << " took " << 1000.0 * single_seconds / rendered << "ms each, "
+            << (single_seconds / rendered) / (seconds / stats.frames) << " times as long" << std::endl;
+    }
+    return 0;
+}